@@ -0,0 +1,140 @@
+#include <board.h>
+#include <stdlib.h>
+#include "task_msg_bus.h"
+
+#define LOG_TAG              "bench"
+#define LOG_LVL              LOG_LVL_DBG
+#include <ulog.h>
+
+#define BENCH_MSG_NAME      TASK_MSG_4
+#define BENCH_MSG_SIZE_MAX  256
+#define BENCH_CONSUMER_PRIORITY     10
+#define BENCH_WAKEUP_LATENCY_MS     10
+
+static volatile rt_uint32_t bench_callback_count = 0;
+static rt_uint8_t bench_buffer[BENCH_MSG_SIZE_MAX];
+
+static void bench_callback(task_msg_args_t args)
+{
+    bench_callback_count++;
+}
+
+/**
+ * Publish count messages and wait until the callback has received all of them.
+ * @return elapsed ticks
+ */
+static rt_tick_t bench_publish(rt_bool_t direct, rt_uint32_t count, rt_size_t msg_size)
+{
+    bench_callback_count = 0;
+    rt_tick_t start = rt_tick_get();
+    for (rt_uint32_t i = 0; i < count; i++)
+    {
+        if (direct)
+            task_msg_publish_obj_direct(BENCH_MSG_NAME, bench_buffer, msg_size);
+        else
+            task_msg_publish_obj(BENCH_MSG_NAME, bench_buffer, msg_size);
+    }
+    while (bench_callback_count < count)
+    {
+        rt_thread_mdelay(1);
+    }
+    return rt_tick_get() - start;
+}
+
+static void bench_report(const char *name, rt_uint32_t count, rt_tick_t ticks)
+{
+    rt_uint32_t us = (rt_uint32_t) ((rt_uint64_t) ticks * 1000000 / RT_TICK_PER_SECOND);
+    LOG_I("%-8s: %d msgs, %d ticks, %d us/msg", name, count, ticks, count ? us / count : 0);
+}
+
+#ifdef RT_USING_HOOK
+static volatile rt_uint32_t bench_switches = 0;
+static struct rt_semaphore bench_done_sem;
+static task_msg_subscriber_t bench_subscriber;
+static rt_uint32_t bench_consumer_count;
+
+static void bench_scheduler_hook(struct rt_thread *from, struct rt_thread *to)
+{
+    bench_switches++;
+}
+
+static void bench_consumer_entry(void *params)
+{
+    task_msg_args_t args;
+    rt_uint32_t received = 0;
+    while (received < bench_consumer_count && task_msg_subscriber_wait(bench_subscriber, 1000, &args) == RT_EOK)
+    {
+        received++;
+        task_msg_release(args);
+    }
+    rt_sem_release(&bench_done_sem);
+}
+
+/**
+ * Queue count messages to a consumer thread which drains them, and count the context switches per message.
+ * @param batch: the wakeup batch of the consumer(0:a wakeup per message)
+ */
+static void bench_wakeup(rt_uint32_t count, rt_size_t msg_size, rt_uint32_t batch)
+{
+    enum task_msg_name msg_name = BENCH_MSG_NAME;
+    bench_subscriber = task_msg_subscriber_open(&msg_name, 1);
+    if (bench_subscriber == RT_NULL)
+        return;
+    if (batch > 1)
+        task_msg_subscriber_wakeup_set(task_msg_subscriber_id(bench_subscriber), batch, BENCH_WAKEUP_LATENCY_MS);
+
+    bench_consumer_count = count;
+    rt_sem_init(&bench_done_sem, "bench", 0, RT_IPC_FLAG_FIFO);
+    rt_thread_t t = rt_thread_create("bench_c", bench_consumer_entry, RT_NULL, 1024, BENCH_CONSUMER_PRIORITY, 10);
+    if (t)
+    {
+        rt_thread_startup(t);
+        bench_switches = 0;
+        rt_scheduler_sethook(bench_scheduler_hook);
+        rt_tick_t start = rt_tick_get();
+        for (rt_uint32_t i = 0; i < count; i++)
+        {
+            task_msg_publish_obj(BENCH_MSG_NAME, bench_buffer, msg_size);
+        }
+        rt_sem_take(&bench_done_sem, RT_WAITING_FOREVER);
+        rt_tick_t ticks = rt_tick_get() - start;
+        rt_scheduler_sethook(RT_NULL);
+
+        rt_uint32_t per_100 = count ? (rt_uint32_t) ((rt_uint64_t) bench_switches * 100 / count) : 0;
+        LOG_I("batch %-3d: %d msgs, %d ticks, %d switches, %d.%02d switches/msg", batch, count, ticks, bench_switches,
+                per_100 / 100, per_100 % 100);
+    }
+    rt_sem_detach(&bench_done_sem);
+    task_msg_subscriber_close(bench_subscriber);
+}
+#endif
+
+/**
+ * Compare the queued publish path with the direct publish path,
+ * and the context switches of a consumer with and without coalesced wakeups.
+ * usage: task_msg_bench [count] [msg_size] [batch]
+ */
+static int task_msg_bench(int argc, char **argv)
+{
+    rt_uint32_t count = 1000;
+    rt_size_t msg_size = 16;
+    if (argc > 1)
+        count = atoi(argv[1]);
+    if (argc > 2)
+        msg_size = atoi(argv[2]);
+    if (msg_size > BENCH_MSG_SIZE_MAX)
+        msg_size = BENCH_MSG_SIZE_MAX;
+
+    task_msg_subscribe(BENCH_MSG_NAME, bench_callback);
+    bench_report("queued", count, bench_publish(RT_FALSE, count, msg_size));
+    bench_report("direct", count, bench_publish(RT_TRUE, count, msg_size));
+    task_msg_unsubscribe(BENCH_MSG_NAME, bench_callback);
+#ifdef RT_USING_HOOK
+    rt_uint32_t batch = argc > 3 ? atoi(argv[3]) : 16;
+    bench_wakeup(count, msg_size, 0);
+    bench_wakeup(count, msg_size, batch);
+#endif
+
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(task_msg_bench, task msg bus benchmark: task_msg_bench [count] [msg_size] [batch]);
@@ -1,4 +1,5 @@
 #include <board.h>
+#include <stdio.h>
 #include "task_msg_bus.h"
 
 #define LOG_TAG              "sample"
@@ -36,13 +37,45 @@ void msg_3_release_hook(void *args)
     if (msg_3->buffer)
     rt_free(msg_3->buffer);
 }
+rt_size_t msg_3_size_hook(void *args)
+{
+    struct msg_3_def *msg_3 = (struct msg_3_def *) args;
+    return msg_3->buffer ? msg_3->buffer_size : 0;
+}
 #endif
 
+struct net_reday_def
+{
+    int net_reday;
+    char ip[16];
+    long id;
+};
+static void *net_reday_decode_hook(task_msg_args_t args)
+{
+    //json: {"net_reday":%d,"ip":"%s","id":%ld}
+    if (args->msg_obj == RT_NULL)
+        return RT_NULL;
+    struct net_reday_def *net_reday = rt_calloc(1, sizeof(struct net_reday_def));
+    if (net_reday == RT_NULL)
+        return RT_NULL;
+    if (sscanf((const char *) args->msg_obj, "{\"net_reday\":%d,\"ip\":\"%15[^\"]\",\"id\":%ld}",
+            &net_reday->net_reday, net_reday->ip, &net_reday->id) != 3)
+    {
+        rt_free(net_reday);
+        return RT_NULL;
+    }
+    return net_reday;
+}
+
 static void net_reday_callback(task_msg_args_t args)
 {
     //这里不要做耗时操作
-    LOG_D("[net_reday_callback]:TASK_MSG_NET_REDAY => args->msg_name:%d, args->msg_obj:%s", args->msg_name,
-            args->msg_obj);
+    struct net_reday_def *net_reday = task_msg_args_decoded(args);
+    if (net_reday)
+    {
+        LOG_D("[net_reday_callback]:TASK_MSG_NET_REDAY => net_reday:%d, ip:%s, id:%ld", net_reday->net_reday,
+                net_reday->ip, net_reday->id);
+    }
 }
 
 static void os_reday_callback(task_msg_args_t args)
@@ -65,8 +98,10 @@ static void msg_wait_thread_entry(void *params)
         rst = task_msg_wait_until(subscriber_id, 50, &args);
         if (rst == RT_EOK)
         {
-            LOG_D("[task_msg_wait_until]:TASK_MSG_NET_REDAY => args.msg_name:%d, args.msg_obj:%s", args->msg_name,
-                    args->msg_obj);
+            //与回调函数共享同一份解码结果，json只解析一次
+            struct net_reday_def *net_reday = task_msg_args_decoded(args);
+            LOG_D("[task_msg_wait_until]:TASK_MSG_NET_REDAY => args.msg_obj:%s, id:%ld", args->msg_obj,
+                    net_reday ? net_reday->id : -1);
             rt_thread_mdelay(200); //模拟耗时操作，在此期间发布的消息不会丢失
             //释放消息
             task_msg_release(args);
@@ -126,6 +161,54 @@ static void msg_wait_any_thread_entry(void *params)
     }
 }
 
+#define POLL_EVENT_NET_REDAY    (1 << 0)
+#define POLL_EVENT_MSG_2        (1 << 1)
+#define POLL_EVENT_USER         (1 << 7)
+static struct rt_event poll_event;
+
+static void msg_poll_thread_entry(void *params)
+{
+    rt_uint32_t recved;
+    task_msg_args_t args;
+    //创建两个消息订阅者，并绑定到同一个事件集
+    int net_subscriber_id = task_msg_subscriber_create(TASK_MSG_NET_REDAY);
+    int msg_2_subscriber_id = task_msg_subscriber_create(TASK_MSG_2);
+    if (net_subscriber_id < 0 || msg_2_subscriber_id < 0)
+        return;
+    task_msg_subscriber_bind_event(net_subscriber_id, &poll_event, POLL_EVENT_NET_REDAY);
+    task_msg_subscriber_bind_event(msg_2_subscriber_id, &poll_event, POLL_EVENT_MSG_2);
+
+    while (1)
+    {
+        //同时等待多个订阅者的消息和其它事件源，无需轮询
+        if (task_msg_poll(&poll_event, POLL_EVENT_NET_REDAY | POLL_EVENT_MSG_2 | POLL_EVENT_USER,
+                RT_WAITING_FOREVER, &recved) != RT_EOK)
+            continue;
+
+        if (recved & POLL_EVENT_NET_REDAY)
+        {
+            while (task_msg_wait_until(net_subscriber_id, 0, &args) == RT_EOK)
+            {
+                LOG_D("[task_msg_poll]:TASK_MSG_NET_REDAY => args.msg_obj:%s", args->msg_obj);
+                task_msg_release(args);
+            }
+        }
+        if (recved & POLL_EVENT_MSG_2)
+        {
+            while (task_msg_wait_until(msg_2_subscriber_id, 0, &args) == RT_EOK)
+            {
+                struct msg_2_def *msg_2 = (struct msg_2_def *) args->msg_obj;
+                LOG_D("[task_msg_poll]:TASK_MSG_2 => msg_2.id:%d", msg_2->id);
+                task_msg_release(args);
+            }
+        }
+        if (recved & POLL_EVENT_USER)
+        {
+            LOG_D("[task_msg_poll]:user event");
+        }
+    }
+}
+
 static void msg_publish_thread_entry(void *params)
 {
     static int i = 0;
@@ -190,6 +273,7 @@ static void msg_publish_thread_entry(void *params)
             break;
         }
 
+        rt_event_send(&poll_event, POLL_EVENT_USER);
         rt_thread_mdelay(50);
         i++;
     }
@@ -199,6 +283,8 @@ static int task_msg_bus_sample(void)
 {
     //初始化消息总线(线程栈大小, 优先级, 时间片)
     task_msg_bus_init();
+    //设置json消息的解码函数，所有订阅者共享解码结果，消息释放时调用rt_free释放解码结果
+    task_msg_decoder_set(TASK_MSG_NET_REDAY, net_reday_decode_hook, rt_free);
     //订阅消息
     task_msg_subscribe(TASK_MSG_NET_REDAY, net_reday_callback);
     task_msg_subscribe(TASK_MSG_OS_REDAY, os_reday_callback);
@@ -208,6 +294,10 @@ static int task_msg_bus_sample(void)
     //创建一个同时等待多个消息的线程
     rt_thread_t t_wait_any = rt_thread_create("msg_wa", msg_wait_any_thread_entry, RT_NULL, 1024, 16, 20);
     rt_thread_startup(t_wait_any);
+    //创建一个同时等待多个订阅者和其它事件源的线程
+    rt_event_init(&poll_event, "msg_poll", RT_IPC_FLAG_PRIO);
+    rt_thread_t t_poll = rt_thread_create("msg_poll", msg_poll_thread_entry, RT_NULL, 1024, 16, 20);
+    rt_thread_startup(t_poll);
     //创建一个发布消息的线程
     rt_thread_t t_publish = rt_thread_create("msg_pub", msg_publish_thread_entry, RT_NULL, 1024, 15, 20);
     rt_thread_startup(t_publish);
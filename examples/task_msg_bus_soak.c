@@ -0,0 +1,236 @@
+#include <board.h>
+#include <stdlib.h>
+#include "task_msg_bus.h"
+
+#define LOG_TAG              "soak"
+#define LOG_LVL              LOG_LVL_DBG
+#include <ulog.h>
+
+#define SOAK_PUBLISHERS      3
+#define SOAK_WAITERS         3
+#define SOAK_STACK_SIZE      1024
+#define SOAK_PRIORITY        20
+#define SOAK_LATENCY_SLOTS   64      /* latency histogram in ticks, the last slot holds the rest */
+#define SOAK_MSG_SIZE_MAX    64
+
+static const enum task_msg_name soak_msg_names[] = { TASK_MSG_1, TASK_MSG_4, TASK_MSG_5 };
+#define SOAK_MSG_NAME_COUNT  ((int) (sizeof(soak_msg_names) / sizeof(enum task_msg_name)))
+
+static volatile rt_bool_t soak_running;
+static struct rt_semaphore soak_done_sem;
+static volatile rt_uint32_t soak_published;
+static volatile rt_uint32_t soak_publish_failed;
+static volatile rt_uint32_t soak_received;
+static volatile rt_uint32_t soak_callbacks;
+static volatile rt_uint32_t soak_churns;
+static rt_uint32_t soak_latency[SOAK_LATENCY_SLOTS];
+
+/**
+ * xorshift32, every thread keeps its own state so runs are reproducible per seed.
+ */
+static rt_uint32_t soak_rand(rt_uint32_t *state)
+{
+    rt_uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void soak_latency_add(task_msg_args_t args)
+{
+    rt_tick_t latency = rt_tick_get() - args->stamp;
+    rt_base_t level = rt_hw_interrupt_disable();
+    soak_latency[latency < SOAK_LATENCY_SLOTS ? latency : SOAK_LATENCY_SLOTS - 1]++;
+    rt_hw_interrupt_enable(level);
+}
+
+static void soak_callback(task_msg_args_t args)
+{
+    soak_callbacks++;
+    soak_latency_add(args);
+}
+
+static void soak_publisher_entry(void *params)
+{
+    rt_uint8_t buffer[SOAK_MSG_SIZE_MAX];
+    rt_uint32_t state = (rt_uint32_t) (rt_ubase_t) params;
+    while (soak_running)
+    {
+        rt_uint32_t r = soak_rand(&state);
+        enum task_msg_name msg_name = soak_msg_names[r % SOAK_MSG_NAME_COUNT];
+        rt_size_t msg_size = (r >> 8) % SOAK_MSG_SIZE_MAX;
+        rt_err_t rst;
+        if ((r >> 16) % 8 == 0)
+            rst = task_msg_publish_obj_direct(msg_name, buffer, msg_size);
+        else
+            rst = task_msg_publish_obj(msg_name, buffer, msg_size);
+        if (rst == RT_EOK)
+            soak_published++;
+        else
+            soak_publish_failed++;
+        if ((r >> 20) % 4 == 0)
+            rt_thread_mdelay(1);
+    }
+    rt_sem_release(&soak_done_sem);
+}
+
+static void soak_waiter_entry(void *params)
+{
+    rt_uint32_t state = (rt_uint32_t) (rt_ubase_t) params;
+    task_msg_args_t args;
+    while (soak_running)
+    {
+        //subscribe to a random non-empty subset of the message names, then delete it after a while
+        enum task_msg_name msg_names[SOAK_MSG_NAME_COUNT];
+        rt_uint8_t count = 0;
+        rt_uint32_t r = soak_rand(&state);
+        for (int i = 0; i < SOAK_MSG_NAME_COUNT; i++)
+        {
+            if (r & (1 << i))
+                msg_names[count++] = soak_msg_names[i];
+        }
+        if (count == 0)
+            msg_names[count++] = soak_msg_names[r % SOAK_MSG_NAME_COUNT];
+
+        int subscriber_id = task_msg_subscriber_create2(msg_names, count);
+        if (subscriber_id < 0)
+        {
+            rt_thread_mdelay(1);
+            continue;
+        }
+        int rounds = 1 + (r >> 8) % 200;
+        for (int i = 0; i < rounds && soak_running; i++)
+        {
+            if (task_msg_wait_until(subscriber_id, 5, &args) == RT_EOK)
+            {
+                soak_received++;
+                soak_latency_add(args);
+                task_msg_release(args);
+            }
+        }
+        task_msg_subscriber_delete(subscriber_id);
+        soak_churns++;
+    }
+    rt_sem_release(&soak_done_sem);
+}
+
+static void soak_churn_entry(void *params)
+{
+    rt_uint32_t state = (rt_uint32_t) (rt_ubase_t) params;
+    while (soak_running)
+    {
+        rt_uint32_t r = soak_rand(&state);
+        enum task_msg_name msg_name = soak_msg_names[r % SOAK_MSG_NAME_COUNT];
+        switch ((r >> 8) % 5)
+        {
+        case 0:
+            task_msg_subscribe(msg_name, soak_callback);
+            break;
+        case 1:
+            task_msg_unsubscribe(msg_name, soak_callback);
+            break;
+        case 2:
+            task_msg_scheduled_start(msg_name, 1 + (r >> 16) % 10, (r >> 24) % 4, 1 + (r >> 12) % 10);
+            break;
+        case 3:
+            task_msg_scheduled_stop(msg_name);
+            break;
+        default:
+            task_msg_scheduled_delete(msg_name);
+            break;
+        }
+        soak_churns++;
+        rt_thread_mdelay(1 + (r >> 28));
+    }
+    rt_sem_release(&soak_done_sem);
+}
+
+/**
+ * @param permille: 500 for the median, 1000 for the maximum
+ * @return latency in ticks, SOAK_LATENCY_SLOTS - 1 means at least that
+ */
+static rt_uint32_t soak_percentile(rt_uint32_t total, rt_uint32_t permille)
+{
+    rt_uint32_t sum = 0;
+    for (int i = 0; i < SOAK_LATENCY_SLOTS; i++)
+    {
+        sum += soak_latency[i];
+        if (sum > 0 && (rt_uint64_t) sum * 1000 >= (rt_uint64_t) total * permille)
+            return i;
+    }
+    return SOAK_LATENCY_SLOTS - 1;
+}
+
+/**
+ * Run publishers, waiters with subscriber churn, callback and scheduled message churn concurrently,
+ * then report the throughput, the delivery latency and the messages which were never released.
+ * usage: task_msg_soak [seconds] [seed]
+ */
+static int task_msg_soak(int argc, char **argv)
+{
+    rt_uint32_t seconds = 10, seed = 1;
+    int threads = 0;
+    if (argc > 1)
+        seconds = atoi(argv[1]);
+    if (argc > 2)
+        seed = atoi(argv[2]);
+    if (seed == 0)
+        seed = 1;
+
+    rt_uint32_t in_flight = task_msg_in_flight();
+    rt_size_t mem_used = task_msg_mem_used();
+    soak_published = soak_publish_failed = soak_received = soak_callbacks = soak_churns = 0;
+    rt_memset(soak_latency, 0, sizeof(soak_latency));
+    rt_sem_init(&soak_done_sem, "soak", 0, RT_IPC_FLAG_FIFO);
+    soak_running = RT_TRUE;
+
+    for (int i = 0; i < SOAK_PUBLISHERS + SOAK_WAITERS + 1; i++)
+    {
+        void (*entry)(void *) = soak_churn_entry;
+        if (i < SOAK_PUBLISHERS)
+            entry = soak_publisher_entry;
+        else if (i < SOAK_PUBLISHERS + SOAK_WAITERS)
+            entry = soak_waiter_entry;
+        rt_thread_t t = rt_thread_create("soak", entry, (void *) (rt_ubase_t) (seed * 2654435761u + i),
+                SOAK_STACK_SIZE, SOAK_PRIORITY + (i % 3), 10);
+        if (t == RT_NULL)
+            break;
+        rt_thread_startup(t);
+        threads++;
+    }
+
+    rt_tick_t start = rt_tick_get();
+    rt_thread_mdelay(seconds * 1000);
+    soak_running = RT_FALSE;
+    for (int i = 0; i < threads; i++)
+    {
+        rt_sem_take(&soak_done_sem, RT_WAITING_FOREVER);
+    }
+    rt_tick_t ticks = rt_tick_get() - start;
+
+    //clean up what the churn left behind, then let the msg_bus thread drain
+    for (int i = 0; i < SOAK_MSG_NAME_COUNT; i++)
+    {
+        task_msg_unsubscribe(soak_msg_names[i], soak_callback);
+        task_msg_scheduled_delete(soak_msg_names[i]);
+    }
+    rt_thread_mdelay(100);
+    rt_sem_detach(&soak_done_sem);
+
+    rt_uint32_t delivered = soak_received + soak_callbacks;
+    rt_uint32_t ms = (rt_uint32_t) ((rt_uint64_t) ticks * 1000 / RT_TICK_PER_SECOND);
+    LOG_I("seed:%d threads:%d time:%d ms churns:%d", seed, threads, ms, soak_churns);
+    LOG_I("published:%d failed:%d received:%d callbacks:%d", soak_published, soak_publish_failed, soak_received,
+            soak_callbacks);
+    LOG_I("throughput: %d published/s, %d delivered/s", ms ? (rt_uint32_t) ((rt_uint64_t) soak_published * 1000 / ms) : 0,
+            ms ? (rt_uint32_t) ((rt_uint64_t) delivered * 1000 / ms) : 0);
+    LOG_I("latency(ticks, %d means at least): p50:%d p99:%d p99.9:%d max:%d", SOAK_LATENCY_SLOTS - 1,
+            soak_percentile(delivered, 500), soak_percentile(delivered, 990), soak_percentile(delivered, 999),
+            soak_percentile(delivered, 1000));
+    LOG_I("leaked: %d messages, %d bytes", task_msg_in_flight() - in_flight, task_msg_mem_used() - mem_used);
+
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(task_msg_soak, task msg bus soak test: task_msg_soak [seconds] [seed]);
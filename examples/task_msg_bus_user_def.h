@@ -28,14 +28,15 @@ enum task_msg_name{
     };
     extern void *msg_3_dup_hook(void *args);
     extern void msg_3_release_hook(void *args);
+    extern rt_size_t msg_3_size_hook(void *args);
     #define task_msg_dup_release_hooks {\
-            {TASK_MSG_OS_REDAY,     RT_NULL, RT_NULL},          \
-            {TASK_MSG_NET_REDAY,    RT_NULL, RT_NULL},          \
-            {TASK_MSG_1,            RT_NULL, RT_NULL},          \
-            {TASK_MSG_2,            RT_NULL, RT_NULL},          \
-            {TASK_MSG_3,            msg_3_dup_hook, msg_3_release_hook},   \
-            {TASK_MSG_4,            RT_NULL, RT_NULL},          \
-            {TASK_MSG_5,            RT_NULL, RT_NULL},          \
+            {TASK_MSG_OS_REDAY,     RT_NULL, RT_NULL, RT_NULL},   \
+            {TASK_MSG_NET_REDAY,    RT_NULL, RT_NULL, RT_NULL},   \
+            {TASK_MSG_1,            RT_NULL, RT_NULL, RT_NULL},   \
+            {TASK_MSG_2,            RT_NULL, RT_NULL, RT_NULL},   \
+            {TASK_MSG_3,            msg_3_dup_hook, msg_3_release_hook, msg_3_size_hook},   \
+            {TASK_MSG_4,            RT_NULL, RT_NULL, RT_NULL},   \
+            {TASK_MSG_5,            RT_NULL, RT_NULL, RT_NULL},   \
         }
 #endif
 
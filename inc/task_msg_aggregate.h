@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_AGGREGATE_H_
+#define TASK_MSG_AGGREGATE_H_
+
+#include <rtthread.h>
+#include "task_msg_bus.h"
+
+enum task_msg_reducer
+{
+    TASK_MSG_REDUCE_AVG = 0,
+    TASK_MSG_REDUCE_MIN,
+    TASK_MSG_REDUCE_MAX,
+    TASK_MSG_REDUCE_SUM,
+    TASK_MSG_REDUCE_COUNT,
+    TASK_MSG_REDUCE_USER,       /* reduce/finish of struct task_msg_aggregate */
+};
+
+enum task_msg_sample_type
+{
+    TASK_MSG_SAMPLE_INT32 = 0,
+    TASK_MSG_SAMPLE_FLOAT,
+};
+
+union task_msg_sample
+{
+    rt_int32_t i32;
+    float f32;
+};
+
+/* the message object published by the built-in reducers */
+struct task_msg_window
+{
+    rt_tick_t start;                /* the tick the window started */
+    rt_uint32_t count;              /* samples in the window */
+    union task_msg_sample value;    /* the reduced value of the sample type, the count for TASK_MSG_REDUCE_COUNT */
+};
+
+struct task_msg_aggregate
+{
+    enum task_msg_name output;          /* the message name of the windows */
+    rt_int32_t window_ms;
+    enum task_msg_reducer reducer;
+    rt_bool_t publish_empty;            /* publish the windows without any sample too */
+    /* the built-in reducers: the number at sample_offset of the message object */
+    enum task_msg_sample_type sample_type;
+    rt_uint16_t sample_offset;
+    /* TASK_MSG_REDUCE_USER: the state is zeroed at every window start, and published as the message object */
+    rt_uint16_t state_size;
+    void (*reduce)(void *state, task_msg_args_t args);  /* called for every sample in the dispatching thread */
+    void (*finish)(void *state, rt_uint32_t count);     /* optional: called before the state is published */
+};
+
+#ifdef TASK_MSG_USING_AGGREGATE
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+rt_err_t task_msg_aggregate_set(enum task_msg_name msg_name, const struct task_msg_aggregate *aggregate);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#endif /* TASK_MSG_AGGREGATE_H_ */
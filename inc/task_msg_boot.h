@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_BOOT_H_
+#define TASK_MSG_BOOT_H_
+
+#include <rtthread.h>
+#include "task_msg_bus.h"
+
+enum task_msg_service_state
+{
+    TASK_MSG_SERVICE_WAITING = 0,   /* some readiness message names have not been published */
+    TASK_MSG_SERVICE_STARTED,
+    TASK_MSG_SERVICE_FAILED,        /* the thread could not be created */
+};
+
+/* a service thread started once all the message names it depends on have been published */
+struct task_msg_service
+{
+    const char *name;
+    void (*entry)(void *parameter);
+    void *parameter;
+    rt_uint32_t stack_size;
+    rt_uint8_t priority;
+    rt_uint32_t tick;
+    const enum task_msg_name *depends;  /* readiness message names */
+    rt_uint8_t depends_count;
+
+    /* managed by the bus */
+    enum task_msg_service_state state;
+    rt_tick_t start_tick;
+    rt_uint8_t unmet;       /* the readiness message names not published yet */
+    struct task_msg_service_depend *depend_nodes;
+    struct task_msg_service *next;
+    struct task_msg_service *start_next;
+};
+typedef struct task_msg_service *task_msg_service_t;
+
+#ifdef TASK_MSG_USING_BOOT
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+rt_err_t task_msg_service_register(task_msg_service_t service);
+rt_bool_t task_msg_ready(enum task_msg_name msg_name);
+rt_err_t task_msg_ready_wait(const enum task_msg_name *msg_name_list, rt_uint8_t msg_name_list_len,
+        rt_int32_t timeout_ms);
+void task_msg_boot_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#endif /* TASK_MSG_BOOT_H_ */
@@ -20,16 +20,44 @@ struct task_msg_args
     enum task_msg_name msg_name;
     void *msg_obj;
     rt_uint32_t msg_size;
+    int ref_count;          /* managed by the bus, see task_msg_retain/task_msg_release */
+    rt_tick_t deadline;     /* 0:never expires, see task_msg_ttl_set/task_msg_args_deadline_set */
+    rt_uint32_t seq;        /* sequence number of the message name, starts from 1 */
+    rt_tick_t stamp;        /* publish tick */
+    void *decoded;          /* the shared decoded form, see task_msg_args_decoded */
+    void (*decoded_free)(void *decoded);    /* frees the decoded form, taken from the decoder that made it */
+    void (*obj_free)(void *msg_obj);    /* frees an attached object instead of rt_free, see task_msg_args_attach */
+    rt_uint8_t origin;      /* TASK_MSG_ORIGIN_XXX, kept by the copies of the message */
 };
 typedef struct task_msg_args *task_msg_args_t;
 
-struct task_msg_ref_node
+/* where a message was published, so a bridge does not send back what it received */
+#define TASK_MSG_ORIGIN_LOCAL   0
+#define TASK_MSG_ORIGIN_SOCKET  1
+
+struct task_msg_stats
 {
-    task_msg_args_t args;
-    int ref_count;
-    rt_slist_t slist;
+    rt_uint32_t expired;    /* dropped at dispatch or at task_msg_wait_until because of the deadline */
+    rt_uint32_t suppressed; /* rejected by the rate limit or the minimum interval */
+    rt_uint32_t debounced;  /* replaced by a later message during the debounce period */
+    rt_uint32_t rejected;   /* rejected because of the memory budget */
+    rt_uint32_t bytes;      /* bytes held now by the messages and wait nodes */
+    rt_uint32_t budget;     /* memory budget(0:unlimited) */
+};
+
+struct task_msg_policy
+{
+    rt_uint32_t rate;           /* token bucket: messages per second(0:unlimited) */
+    rt_uint32_t burst;          /* token bucket: bucket size(0:1) */
+    rt_int32_t min_interval_ms; /* the minimum interval between two messages(0:none) */
+    rt_int32_t debounce_ms;     /* publish only the last message after a quiet period(0:none) */
+};
+
+struct task_msg_iov
+{
+    void *iov_base;
+    rt_size_t iov_len;
 };
-typedef struct task_msg_ref_node *task_msg_ref_node_t;
 
 struct task_msg_args_node
 {
@@ -38,27 +66,34 @@ struct task_msg_args_node
 };
 typedef struct task_msg_args_node *task_msg_args_node_t;
 
-struct task_msg_callback_node
+struct task_msg_callback_item
 {
-    void (*callback)(const task_msg_args_t msg_args);
-    rt_slist_t slist;
+    void (*callback)(task_msg_args_t msg_args);
+    rt_uint8_t priority;    /* the smaller the earlier, like the thread priority */
 };
-typedef struct task_msg_callback_node *task_msg_callback_node_t;
 
-struct task_msg_subscriber_node
+struct task_msg_callback_set
 {
-    int subscriber_id;
-    enum task_msg_name msg_name;
-    rt_sem_t sem;
-    rt_slist_t slist;
+    int ref_count;
+    int count;
+    struct task_msg_callback_item item[];  /* sorted by priority */
 };
-typedef struct task_msg_subscriber_node *task_msg_subscriber_node_t;
+typedef struct task_msg_callback_set *task_msg_callback_set_t;
+
+typedef struct task_msg_subscriber *task_msg_subscriber_t;
+
+struct task_msg_subscriber_set
+{
+    int ref_count;
+    int count;
+    task_msg_subscriber_t subscriber[];    /* sorted by priority */
+};
+typedef struct task_msg_subscriber_set *task_msg_subscriber_set_t;
 
 struct task_msg_wait_node
 {
-    task_msg_subscriber_node_t subscriber;
     task_msg_args_t args;
-    rt_slist_t slist;
+    rt_list_t list;         /* in the pending list of the subscriber */
 };
 typedef struct task_msg_wait_node *task_msg_wait_node_t;
 
@@ -67,36 +102,114 @@ struct task_msg_dup_release_hook
     enum task_msg_name msg_name;
     void *(*dup)(void *args);
     void (*release)(void *args);
+    rt_size_t (*size)(void *args);  /* optional: the bytes dup allocates beyond msg_size */
+};
+
+enum task_msg_catchup
+{
+    TASK_MSG_CATCHUP_SKIP = 0,      /* publish once, drop the missed periods and keep the phase */
+    TASK_MSG_CATCHUP_BURST,         /* publish once for every missed period and keep the phase */
+    TASK_MSG_CATCHUP_COALESCE,      /* publish once for the missed periods and restart the period from now */
+};
+
+struct task_msg_schedule_stats
+{
+    rt_uint32_t fired;          /* messages published, or produce calls of a producer schedule */
+    rt_uint32_t missed;         /* periods without their own message */
+    rt_tick_t lateness_last;    /* ticks between the due tick and the publish */
+    rt_tick_t lateness_max;
+    rt_tick_t lateness_avg;
 };
 
 struct task_msg_timer_node
 {
     task_msg_args_t args;
-    struct rt_timer timer;
     rt_uint32_t repeat;
-    rt_uint32_t do_count;
+    rt_uint32_t do_count;       /* periods done, the missed ones included */
     rt_bool_t stop;
+    rt_bool_t restart;          /* publish at once, see task_msg_schedule_restart */
     rt_tick_t interval;
+    rt_tick_t next;             /* the absolute due tick of the next period */
+    enum task_msg_catchup catchup;
+    struct task_msg_schedule_stats stats;
+    rt_uint32_t lateness_sum;
+    rt_uint32_t lateness_count;
+    task_msg_args_t (*produce)(void *parameter);   /* makes the message when due, see task_msg_schedule_create_producer */
+    void *parameter;
     rt_slist_t slist;
 };
 typedef struct task_msg_timer_node *task_msg_timer_node_t;
+typedef struct task_msg_timer_node *task_msg_schedule_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 int task_msg_bus_init(void);
 rt_err_t task_msg_subscribe(enum task_msg_name msg_name, void (*callback)(task_msg_args_t msg_args));
+rt_err_t task_msg_subscribe_priority(enum task_msg_name msg_name, void (*callback)(task_msg_args_t msg_args),
+        rt_uint8_t priority);
 rt_err_t task_msg_unsubscribe(enum task_msg_name msg_name, void (*callback)(task_msg_args_t msg_args));
 rt_err_t task_msg_publish(enum task_msg_name msg_name, const char *msg_text);
 rt_err_t task_msg_publish_obj(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size);
+rt_err_t task_msg_publish_obj_direct(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size);
+rt_err_t task_msg_direct_set(enum task_msg_name msg_name, rt_bool_t direct);
+task_msg_args_t task_msg_args_alloc(enum task_msg_name msg_name, rt_size_t msg_size);
+rt_err_t task_msg_publish_args(task_msg_args_t args);
+task_msg_args_t task_msg_args_attach(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size,
+        void (*obj_free)(void *msg_obj));
+void task_msg_args_deadline_set(task_msg_args_t args, rt_int32_t timeout_ms);
+rt_err_t task_msg_ttl_set(enum task_msg_name msg_name, rt_int32_t ttl_ms);
+rt_err_t task_msg_policy_set(enum task_msg_name msg_name, const struct task_msg_policy *policy);
+rt_err_t task_msg_budget_set(enum task_msg_name msg_name, rt_size_t budget);
+rt_err_t task_msg_decoder_set(enum task_msg_name msg_name, void *(*decode)(task_msg_args_t args),
+        void (*release)(void *decoded));
+void *task_msg_args_decoded(task_msg_args_t args);
+void task_msg_budget_set_global(rt_size_t budget);
+rt_size_t task_msg_mem_used(void);
+rt_err_t task_msg_stats_get(enum task_msg_name msg_name, struct task_msg_stats *stats);
+rt_err_t task_msg_publish_iov(enum task_msg_name msg_name, const struct task_msg_iov *parts, rt_size_t count);
+rt_size_t task_msg_args_scatter(task_msg_args_t args, const struct task_msg_iov *parts, rt_size_t count);
 
 rt_err_t task_msg_scheduled_append(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size);
 rt_err_t task_msg_scheduled_start(enum task_msg_name msg_name, int delay_ms, rt_uint32_t repeat, int interval_ms);
 rt_err_t task_msg_scheduled_restart(enum task_msg_name msg_name);
 rt_err_t task_msg_scheduled_stop(enum task_msg_name msg_name);
 void task_msg_scheduled_delete(enum task_msg_name msg_name);
+task_msg_schedule_t task_msg_schedule_create(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size);
+task_msg_schedule_t task_msg_schedule_create_producer(enum task_msg_name msg_name,
+        task_msg_args_t (*produce)(void *parameter), void *parameter);
+rt_err_t task_msg_schedule_update(task_msg_schedule_t schedule, void *msg_obj, rt_size_t msg_size);
+rt_err_t task_msg_schedule_start(task_msg_schedule_t schedule, int delay_ms, rt_uint32_t repeat, int interval_ms);
+rt_err_t task_msg_schedule_restart(task_msg_schedule_t schedule);
+rt_err_t task_msg_schedule_stop(task_msg_schedule_t schedule);
+rt_err_t task_msg_schedule_catchup_set(task_msg_schedule_t schedule, enum task_msg_catchup catchup);
+rt_err_t task_msg_schedule_stats_get(task_msg_schedule_t schedule, struct task_msg_schedule_stats *stats);
+void task_msg_schedule_delete(task_msg_schedule_t schedule);
 
 int task_msg_subscriber_create(enum task_msg_name msg_name);
 int task_msg_subscriber_create2(const enum task_msg_name *msg_name_list, rt_uint8_t msg_name_list_len);
 void task_msg_subscriber_delete(int subscriber_id);
+rt_err_t task_msg_subscriber_priority_set(int subscriber_id, rt_uint8_t priority);
+rt_err_t task_msg_subscriber_wakeup_set(int subscriber_id, rt_uint32_t batch, rt_int32_t max_latency_ms);
+task_msg_subscriber_t task_msg_subscriber_open(const enum task_msg_name *msg_name_list, rt_uint8_t msg_name_list_len);
+int task_msg_subscriber_id(task_msg_subscriber_t subscriber);
+rt_err_t task_msg_subscriber_add(task_msg_subscriber_t subscriber, enum task_msg_name msg_name);
+rt_err_t task_msg_subscriber_remove(task_msg_subscriber_t subscriber, enum task_msg_name msg_name);
+rt_err_t task_msg_subscriber_interrupt(task_msg_subscriber_t subscriber);
+rt_err_t task_msg_subscriber_wait(task_msg_subscriber_t subscriber, rt_int32_t timeout_ms, task_msg_args_t *out_args);
+void task_msg_subscriber_close(task_msg_subscriber_t subscriber);
 rt_err_t task_msg_wait_until(int subscriber_id, rt_int32_t timeout_ms, struct task_msg_args **out_args);
+rt_err_t task_msg_subscriber_gap(int subscriber_id, enum task_msg_name msg_name, rt_uint32_t *gap);
+rt_err_t task_msg_subscriber_bind_event(int subscriber_id, rt_event_t event, rt_uint32_t set);
+rt_err_t task_msg_poll(rt_event_t event, rt_uint32_t set, rt_int32_t timeout_ms, rt_uint32_t *recved);
+task_msg_args_t task_msg_retain(task_msg_args_t args);
 void task_msg_release(task_msg_args_t args);
+rt_uint32_t task_msg_in_flight(void);
+rt_uint32_t task_msg_last_seq(enum task_msg_name msg_name);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* TASK_MSG_BUS_H_ */
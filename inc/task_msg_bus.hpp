@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_BUS_HPP_
+#define TASK_MSG_BUS_HPP_
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "task_msg_bus.h"
+#ifdef TASK_MSG_USING_LOOP
+#include "task_msg_loop.h"
+#endif
+
+namespace task_msg
+{
+
+/**
+ * A received message, released when the handle is destroyed, reset or assigned.
+ * It is move-only, so the release can be neither forgotten nor done twice.
+ */
+template <typename T>
+class message
+{
+public:
+    message() : args_(RT_NULL) {}
+    explicit message(task_msg_args_t args) : args_(args) {}
+    message(message &&other) : args_(other.args_)
+    {
+        other.args_ = RT_NULL;
+    }
+    message &operator=(message &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            args_ = other.args_;
+            other.args_ = RT_NULL;
+        }
+        return *this;
+    }
+    message(const message &) = delete;
+    message &operator=(const message &) = delete;
+    ~message()
+    {
+        reset();
+    }
+
+    explicit operator bool() const
+    {
+        return args_ != RT_NULL;
+    }
+    const T *get() const
+    {
+        return args_ ? static_cast<const T *>(args_->msg_obj) : RT_NULL;
+    }
+    template <typename U = T>
+    const U &operator*() const
+    {
+        return *get();
+    }
+    const T *operator->() const
+    {
+        return get();
+    }
+    /* the message header: seq, stamp, deadline... */
+    task_msg_args_t args() const
+    {
+        return args_;
+    }
+
+    /* another handle to the same read-only message, see task_msg_retain */
+    message retain() const
+    {
+        return message(args_ ? task_msg_retain(args_) : RT_NULL);
+    }
+    /* give the message back to the caller, who must release it */
+    task_msg_args_t detach()
+    {
+        task_msg_args_t args = args_;
+        args_ = RT_NULL;
+        return args;
+    }
+    void reset()
+    {
+        if (args_)
+        {
+            task_msg_release(args_);
+            args_ = RT_NULL;
+        }
+    }
+
+private:
+    task_msg_args_t args_;
+};
+
+namespace detail
+{
+
+/* messages of the same name published from C may carry another object */
+template <typename T>
+inline bool payload_fits(task_msg_args_t args)
+{
+    return args->msg_obj != RT_NULL && args->msg_size >= sizeof(T);
+}
+template <>
+inline bool payload_fits<void>(task_msg_args_t)
+{
+    return true;
+}
+
+template <typename T, typename F>
+struct invoker
+{
+    static void call(F &f, task_msg_args_t args)
+    {
+        f(*static_cast<const T *>(args->msg_obj));
+    }
+};
+template <typename F>
+struct invoker<void, F>
+{
+    static void call(F &f, task_msg_args_t)
+    {
+        f();
+    }
+};
+
+/* hand a received message to msg, or release it if its object is smaller than T */
+template <typename T>
+inline rt_err_t accept(rt_err_t rst, task_msg_args_t args, task_msg::message<T> &msg)
+{
+    if (rst != RT_EOK)
+        return rst;
+    if (!payload_fits<T>(args))
+    {
+        task_msg_release(args);
+        return -RT_ERROR;
+    }
+    msg = task_msg::message<T>(args);
+    return RT_EOK;
+}
+
+/**
+ * The C callback of a lambda: the bus callbacks have no context argument, so the lambda is copied
+ * into a static slot of its own type instead of the heap. Every lambda expression has a distinct type,
+ * so a slot is bound by one subscription at a time.
+ * A dispatch may still hold a snapshot of the callbacks after the unsubscribe, so the slot stays bound
+ * until the last running call has returned, and a call entered after the unbind does not touch the slot.
+ */
+template <enum task_msg_name Name, typename T, typename F>
+struct trampoline
+{
+    static_assert(std::is_class<F>::value, "subscribe a lambda, plain functions share one slot per signature");
+    static_assert(std::is_trivially_destructible<F>::value, "the lambda is kept in a static slot and never destroyed");
+
+    static typename std::aligned_storage<sizeof(F), alignof(F)>::type slot;
+    static bool bound;      /* the slot is owned by a subscription or still used by a running call */
+    static bool ready;      /* the lambda in the slot can be called */
+    static int running;
+
+    static void callback(task_msg_args_t args)
+    {
+        rt_base_t level = rt_hw_interrupt_disable();
+        if (!ready)
+        {
+            rt_hw_interrupt_enable(level);
+            return;
+        }
+        running++;
+        rt_hw_interrupt_enable(level);
+
+        if (payload_fits<T>(args))
+        {
+            invoker<T, F>::call(*reinterpret_cast<F *>(&slot), args);
+        }
+
+        level = rt_hw_interrupt_disable();
+        if (--running == 0 && !ready)
+        {
+            bound = false;
+        }
+        rt_hw_interrupt_enable(level);
+    }
+    static bool bind(const F &f)
+    {
+        rt_base_t level = rt_hw_interrupt_disable();
+        bool busy = bound;
+        bound = true;
+        rt_hw_interrupt_enable(level);
+        if (busy)
+            return false;
+
+        new (&slot) F(f);
+        level = rt_hw_interrupt_disable();
+        ready = true;
+        rt_hw_interrupt_enable(level);
+        return true;
+    }
+    /* the last running call frees the slot, so it is safe inside the lambda itself */
+    static void unbind()
+    {
+        rt_base_t level = rt_hw_interrupt_disable();
+        ready = false;
+        if (running == 0)
+        {
+            bound = false;
+        }
+        rt_hw_interrupt_enable(level);
+    }
+};
+template <enum task_msg_name Name, typename T, typename F>
+typename std::aligned_storage<sizeof(F), alignof(F)>::type trampoline<Name, T, F>::slot;
+template <enum task_msg_name Name, typename T, typename F>
+bool trampoline<Name, T, F>::bound = false;
+template <enum task_msg_name Name, typename T, typename F>
+bool trampoline<Name, T, F>::ready = false;
+template <enum task_msg_name Name, typename T, typename F>
+int trampoline<Name, T, F>::running = 0;
+
+} /* namespace detail */
+
+/**
+ * A callback subscription, unsubscribed when the handle is destroyed or reset. Empty if the subscribe failed.
+ */
+class subscription
+{
+public:
+    subscription() : name_(TASK_MSG_COUNT), callback_(RT_NULL), unbind_(RT_NULL)
+#ifdef TASK_MSG_USING_LOOP
+            , loop_(RT_NULL)
+#endif
+    {
+    }
+    subscription(enum task_msg_name name, void (*callback)(task_msg_args_t), void (*unbind)(void)) :
+            name_(name), callback_(callback), unbind_(unbind)
+#ifdef TASK_MSG_USING_LOOP
+            , loop_(RT_NULL)
+#endif
+    {
+    }
+#ifdef TASK_MSG_USING_LOOP
+    subscription(task_msg_loop_t loop, enum task_msg_name name, void (*callback)(task_msg_args_t),
+            void (*unbind)(void)) :
+            name_(name), callback_(callback), unbind_(unbind), loop_(loop)
+    {
+    }
+#endif
+    subscription(subscription &&other) : subscription()
+    {
+        swap(other);
+    }
+    subscription &operator=(subscription &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            swap(other);
+        }
+        return *this;
+    }
+    subscription(const subscription &) = delete;
+    subscription &operator=(const subscription &) = delete;
+    ~subscription()
+    {
+        reset();
+    }
+
+    explicit operator bool() const
+    {
+        return callback_ != RT_NULL;
+    }
+    void reset()
+    {
+        if (callback_ == RT_NULL)
+            return;
+
+#ifdef TASK_MSG_USING_LOOP
+        if (loop_)
+            task_msg_loop_unsubscribe(loop_, name_);
+        else
+#endif
+            task_msg_unsubscribe(name_, callback_);
+        unbind_();
+        callback_ = RT_NULL;
+    }
+
+private:
+    void swap(subscription &other)
+    {
+        std::swap(name_, other.name_);
+        std::swap(callback_, other.callback_);
+        std::swap(unbind_, other.unbind_);
+#ifdef TASK_MSG_USING_LOOP
+        std::swap(loop_, other.loop_);
+#endif
+    }
+
+    enum task_msg_name name_;
+    void (*callback_)(task_msg_args_t);
+    void (*unbind_)(void);
+#ifdef TASK_MSG_USING_LOOP
+    task_msg_loop_t loop_;
+#endif
+};
+
+template <enum task_msg_name Name, typename T>
+struct topic_base
+{
+    typedef T type;
+    typedef task_msg::message<T> message;
+    static const enum task_msg_name name = Name;
+
+    /**
+     * Subscribe a lambda taking const T &(no argument for topic<Name, void>), it is called in the msg_bus thread.
+     * Wrap a plain function in a lambda, every lambda expression can be subscribed once at a time.
+     */
+    template <typename F>
+    static subscription subscribe(const F &f)
+    {
+        typedef detail::trampoline<Name, T, F> slot;
+        if (!slot::bind(f))
+            return subscription();
+        if (task_msg_subscribe(Name, slot::callback) != RT_EOK)
+        {
+            slot::unbind();
+            return subscription();
+        }
+        return subscription(Name, slot::callback, slot::unbind);
+    }
+    template <typename F>
+    static subscription subscribe(const F &f, rt_uint8_t priority)
+    {
+        typedef detail::trampoline<Name, T, F> slot;
+        if (!slot::bind(f))
+            return subscription();
+        if (task_msg_subscribe_priority(Name, slot::callback, priority) != RT_EOK)
+        {
+            slot::unbind();
+            return subscription();
+        }
+        return subscription(Name, slot::callback, slot::unbind);
+    }
+#ifdef TASK_MSG_USING_LOOP
+    /* the lambda is called in the thread running the loop */
+    template <typename F>
+    static subscription subscribe(task_msg_loop_t loop, const F &f)
+    {
+        typedef detail::trampoline<Name, T, F> slot;
+        if (!slot::bind(f))
+            return subscription();
+        if (task_msg_loop_subscribe(loop, Name, slot::callback) != RT_EOK)
+        {
+            slot::unbind();
+            return subscription();
+        }
+        return subscription(loop, Name, slot::callback, slot::unbind);
+    }
+#endif
+};
+
+/**
+ * Bind a message name to its object type, e.g.
+ * typedef task_msg::topic<TASK_MSG_NET_REDAY, struct net_reday_def> net_reday_topic;
+ */
+template <enum task_msg_name Name, typename T>
+struct topic : topic_base<Name, T>
+{
+    static_assert(std::is_trivially_copyable<T>::value, "the bus copies the object byte by byte, see task_msg_publish_obj");
+
+    static rt_err_t publish(const T &obj)
+    {
+        return task_msg_publish_obj(Name, const_cast<T *>(&obj), sizeof(T));
+    }
+    static rt_err_t publish_direct(const T &obj)
+    {
+        return task_msg_publish_obj_direct(Name, const_cast<T *>(&obj), sizeof(T));
+    }
+};
+
+/* a message without object */
+template <enum task_msg_name Name>
+struct topic<Name, void> : topic_base<Name, void>
+{
+    static rt_err_t publish()
+    {
+        return task_msg_publish_obj(Name, RT_NULL, 0);
+    }
+    static rt_err_t publish_direct()
+    {
+        return task_msg_publish_obj_direct(Name, RT_NULL, 0);
+    }
+};
+
+/**
+ * A waiting subscriber of one topic, see task_msg_subscriber_open. Empty if the open failed.
+ */
+template <typename Topic>
+class subscriber
+{
+public:
+    typedef typename Topic::message message;
+
+    subscriber()
+    {
+        enum task_msg_name name = Topic::name;
+        handle_ = task_msg_subscriber_open(&name, 1);
+    }
+    subscriber(subscriber &&other) : handle_(other.handle_)
+    {
+        other.handle_ = RT_NULL;
+    }
+    subscriber &operator=(subscriber &&other)
+    {
+        if (this != &other)
+        {
+            close();
+            handle_ = other.handle_;
+            other.handle_ = RT_NULL;
+        }
+        return *this;
+    }
+    subscriber(const subscriber &) = delete;
+    subscriber &operator=(const subscriber &) = delete;
+    ~subscriber()
+    {
+        close();
+    }
+
+    explicit operator bool() const
+    {
+        return handle_ != RT_NULL;
+    }
+
+    /**
+     * Wait for a message, the previous one held by msg is released.
+     *
+     * @param msg: the received message
+     * @param timeout_ms: the waiting millisecond (-1:waiting forever until get resource)
+     * @return error code, -RT_ERROR if the object of the message is smaller than the type of the topic
+     */
+    rt_err_t wait(message &msg, rt_int32_t timeout_ms = RT_WAITING_FOREVER)
+    {
+        msg.reset();
+        if (handle_ == RT_NULL)
+            return -RT_EINVAL;
+
+        task_msg_args_t args;
+        rt_err_t rst = task_msg_subscriber_wait(handle_, timeout_ms, &args);
+        return detail::accept(rst, args, msg);
+    }
+    /* empty if failed */
+    message wait(rt_int32_t timeout_ms = RT_WAITING_FOREVER)
+    {
+        message msg;
+        wait(msg, timeout_ms);
+        return msg;
+    }
+    rt_err_t interrupt()
+    {
+        return task_msg_subscriber_interrupt(handle_);
+    }
+    int id() const
+    {
+        return handle_ ? task_msg_subscriber_id(handle_) : -1;
+    }
+    task_msg_subscriber_t handle() const
+    {
+        return handle_;
+    }
+
+private:
+    void close()
+    {
+        if (handle_)
+        {
+            task_msg_subscriber_close(handle_);
+            handle_ = RT_NULL;
+        }
+    }
+
+    task_msg_subscriber_t handle_;
+};
+
+/**
+ * A waiting subscriber of one topic by id, see task_msg_subscriber_create and task_msg_wait_until.
+ * Empty if the create failed.
+ */
+template <typename Topic>
+class waiter
+{
+public:
+    typedef typename Topic::message message;
+
+    waiter() : id_(task_msg_subscriber_create(Topic::name))
+    {
+    }
+    waiter(waiter &&other) : id_(other.id_)
+    {
+        other.id_ = -1;
+    }
+    waiter &operator=(waiter &&other)
+    {
+        if (this != &other)
+        {
+            close();
+            id_ = other.id_;
+            other.id_ = -1;
+        }
+        return *this;
+    }
+    waiter(const waiter &) = delete;
+    waiter &operator=(const waiter &) = delete;
+    ~waiter()
+    {
+        close();
+    }
+
+    explicit operator bool() const
+    {
+        return id_ >= 0;
+    }
+
+    /**
+     * Wait for a message, the previous one held by msg is released.
+     *
+     * @param msg: the received message
+     * @param timeout_ms: the waiting millisecond (-1:waiting forever until get resource)
+     * @return error code, -RT_ERROR if the object of the message is smaller than the type of the topic
+     */
+    rt_err_t wait(message &msg, rt_int32_t timeout_ms = RT_WAITING_FOREVER)
+    {
+        msg.reset();
+        if (id_ < 0)
+            return -RT_EINVAL;
+
+        task_msg_args_t args;
+        rt_err_t rst = task_msg_wait_until(id_, timeout_ms, &args);
+        return detail::accept(rst, args, msg);
+    }
+    /* empty if failed */
+    message wait(rt_int32_t timeout_ms = RT_WAITING_FOREVER)
+    {
+        message msg;
+        wait(msg, timeout_ms);
+        return msg;
+    }
+    rt_err_t priority_set(rt_uint8_t priority)
+    {
+        return task_msg_subscriber_priority_set(id_, priority);
+    }
+    int id() const
+    {
+        return id_;
+    }
+
+private:
+    void close()
+    {
+        if (id_ >= 0)
+        {
+            task_msg_subscriber_delete(id_);
+            id_ = -1;
+        }
+    }
+
+    int id_;
+};
+
+} /* namespace task_msg */
+
+#endif /* TASK_MSG_BUS_HPP_ */
@@ -27,8 +27,8 @@ enum task_msg_name
 };
 #ifdef TASK_MSG_USING_DYNAMIC_MEMORY
 #define task_msg_dup_release_hooks {                    \
-                {TASK_MSG_OS_REDAY, RT_NULL, RT_NULL},   \
-                {TASK_MSG_NET_REDAY, RT_NULL, RT_NULL},  \
+                {TASK_MSG_OS_REDAY, RT_NULL, RT_NULL, RT_NULL},   \
+                {TASK_MSG_NET_REDAY, RT_NULL, RT_NULL, RT_NULL},  \
             }
 #endif
 #endif
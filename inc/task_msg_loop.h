@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_LOOP_H_
+#define TASK_MSG_LOOP_H_
+
+#include <rtthread.h>
+#include "task_msg_bus.h"
+
+typedef struct task_msg_loop *task_msg_loop_t;
+
+#ifdef TASK_MSG_USING_LOOP
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+task_msg_loop_t task_msg_loop_create(void);
+rt_err_t task_msg_loop_subscribe(task_msg_loop_t loop, enum task_msg_name msg_name,
+        void (*callback)(task_msg_args_t msg_args));
+rt_err_t task_msg_loop_unsubscribe(task_msg_loop_t loop, enum task_msg_name msg_name);
+rt_err_t task_msg_loop_run_once(task_msg_loop_t loop, rt_int32_t timeout_ms);
+rt_err_t task_msg_loop_run(task_msg_loop_t loop);
+rt_err_t task_msg_loop_quit(task_msg_loop_t loop);
+void task_msg_loop_delete(task_msg_loop_t loop);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#endif /* TASK_MSG_LOOP_H_ */
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_RECORD_H_
+#define TASK_MSG_RECORD_H_
+
+#include <rtthread.h>
+#include "task_msg_bus_def.h"
+
+#define TASK_MSG_RECORD_MAGIC   0x434D4D54  /* "TMMC" */
+#define TASK_MSG_RECORD_VERSION 1
+
+struct task_msg_record_file_header
+{
+    rt_uint32_t magic;
+    rt_uint16_t version;
+    rt_uint16_t tick_per_second;
+};
+
+struct task_msg_record_header
+{
+    rt_uint32_t tick;
+    rt_uint16_t msg_name;
+    rt_uint16_t reserved;
+    rt_uint32_t msg_size;
+};
+
+struct task_msg_record_stats
+{
+    rt_uint32_t recorded;
+    rt_uint32_t dropped;
+    rt_uint32_t bytes;
+};
+
+#ifdef TASK_MSG_USING_RECORD
+rt_err_t task_msg_record_start(const char *path);
+void task_msg_record_stop(void);
+void task_msg_record_stats(struct task_msg_record_stats *stats);
+void task_msg_record_capture(enum task_msg_name msg_name, const void *msg_obj, rt_size_t msg_size);
+rt_err_t task_msg_replay_start(const char *path, rt_uint32_t speed_percent, rt_uint32_t loops);
+void task_msg_replay_stop(void);
+#define TASK_MSG_RECORD(msg_name, msg_obj, msg_size) task_msg_record_capture(msg_name, msg_obj, msg_size)
+#else
+#define TASK_MSG_RECORD(msg_name, msg_obj, msg_size) do {} while (0)
+#endif
+
+#endif /* TASK_MSG_RECORD_H_ */
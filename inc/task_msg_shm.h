@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_SHM_H_
+#define TASK_MSG_SHM_H_
+
+#include <rtthread.h>
+#include "task_msg_bus_def.h"
+
+#ifndef TASK_MSG_SHM_CACHE_LINE
+#define TASK_MSG_SHM_CACHE_LINE 32
+#endif
+
+#define TASK_MSG_SHM_MAGIC 0x4853544D  /* "MTSH" */
+
+/* single-producer/single-consumer ring, lives in the shared memory */
+struct task_msg_shm_ring
+{
+    volatile rt_uint32_t head;  /* written by the producer only */
+    rt_uint8_t reserved0[TASK_MSG_SHM_CACHE_LINE - sizeof(rt_uint32_t)];
+    volatile rt_uint32_t tail;  /* written by the consumer only */
+    rt_uint8_t reserved1[TASK_MSG_SHM_CACHE_LINE - sizeof(rt_uint32_t)];
+    rt_uint32_t size;           /* data size, power of 2 */
+    volatile rt_uint32_t magic;
+    rt_uint8_t reserved2[TASK_MSG_SHM_CACHE_LINE - 2 * sizeof(rt_uint32_t)];
+    rt_uint8_t data[];
+};
+
+struct task_msg_shm_record
+{
+    rt_uint16_t msg_name;
+    rt_uint16_t reserved;
+    rt_uint32_t msg_size;
+};
+
+struct task_msg_shm_stats
+{
+    rt_uint32_t tx_count;
+    rt_uint32_t tx_dropped;
+    rt_uint32_t rx_count;
+    rt_uint32_t rx_dropped;
+};
+
+#ifdef TASK_MSG_USING_SHM_BRIDGE
+rt_err_t task_msg_shm_bridge_init(void *shm, rt_size_t shm_size, rt_bool_t master, void (*doorbell)(void));
+rt_err_t task_msg_shm_bridge_export(enum task_msg_name msg_name);
+void task_msg_shm_bridge_doorbell_isr(void);
+void task_msg_shm_bridge_stats(struct task_msg_shm_stats *stats);
+#endif
+
+#endif /* TASK_MSG_SHM_H_ */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_SOCKET_H_
+#define TASK_MSG_SOCKET_H_
+
+#include <rtthread.h>
+#include "task_msg_bus_def.h"
+
+/* frame on the stream: header(little-endian) + msg_size bytes of message object */
+struct task_msg_socket_frame
+{
+    rt_uint16_t msg_name;
+    rt_uint16_t msg_size;
+};
+
+struct task_msg_socket_stats
+{
+    rt_uint32_t tx_count;
+    rt_uint32_t tx_dropped;
+    rt_uint32_t tx_writes;
+    rt_uint32_t rx_count;
+    rt_uint32_t rx_dropped;
+    rt_uint32_t rx_reads;
+};
+
+#ifdef TASK_MSG_USING_SOCKET_BRIDGE
+rt_err_t task_msg_socket_bridge_start(rt_uint16_t port);
+rt_err_t task_msg_socket_bridge_export(enum task_msg_name msg_name);
+void task_msg_socket_bridge_stats(struct task_msg_socket_stats *stats);
+#endif
+
+#endif /* TASK_MSG_SOCKET_H_ */
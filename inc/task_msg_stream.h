@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_STREAM_H_
+#define TASK_MSG_STREAM_H_
+
+#include <rtthread.h>
+#include "task_msg_bus.h"
+
+#define TASK_MSG_CHUNK_END      0x01    /* the last chunk of the stream */
+#define TASK_MSG_CHUNK_ABORT    0x02    /* the producer gave up, the data received so far is incomplete */
+
+/* the message object of a stream message */
+struct task_msg_chunk
+{
+    rt_uint32_t stream_id;  /* tells apart the streams published on the same message name */
+    rt_uint32_t offset;     /* offset of the data in the whole stream */
+    rt_uint32_t total;      /* size of the whole stream(0:unknown) */
+    rt_uint16_t len;        /* bytes in data */
+    rt_uint16_t flags;
+    rt_uint8_t data[];
+};
+typedef struct task_msg_chunk *task_msg_chunk_t;
+
+typedef struct task_msg_stream *task_msg_stream_t;
+
+#ifdef TASK_MSG_USING_STREAM
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+task_msg_stream_t task_msg_stream_open(enum task_msg_name msg_name, rt_uint16_t chunk_size, rt_uint8_t credits,
+        rt_uint32_t total);
+rt_size_t task_msg_stream_write(task_msg_stream_t stream, const void *buffer, rt_size_t size, rt_int32_t timeout_ms);
+rt_err_t task_msg_stream_close(task_msg_stream_t stream);
+rt_err_t task_msg_stream_abort(task_msg_stream_t stream);
+const struct task_msg_chunk *task_msg_chunk_get(task_msg_args_t args);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#endif /* TASK_MSG_STREAM_H_ */
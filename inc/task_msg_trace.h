@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+#ifndef TASK_MSG_TRACE_H_
+#define TASK_MSG_TRACE_H_
+
+#include <rtthread.h>
+
+#ifndef TASK_MSG_TRACE_RECORDS
+#define TASK_MSG_TRACE_RECORDS 256     /* must be a power of 2 */
+#endif
+
+enum task_msg_trace_event
+{
+    TASK_MSG_TRACE_PUBLISH = 0,
+    TASK_MSG_TRACE_DISPATCH_START,
+    TASK_MSG_TRACE_DISPATCH_END,
+    TASK_MSG_TRACE_CALLBACK_ENTER,
+    TASK_MSG_TRACE_CALLBACK_EXIT,
+    TASK_MSG_TRACE_WAIT_WAKEUP,
+    TASK_MSG_TRACE_RELEASE,
+    TASK_MSG_TRACE_DROP,
+    TASK_MSG_TRACE_TIMER_FIRE,
+    TASK_MSG_TRACE_EXPIRE,
+    TASK_MSG_TRACE_EVENT_COUNT
+};
+
+struct task_msg_trace_record
+{
+    rt_uint32_t stamp;
+    rt_uint8_t event;
+    rt_uint8_t msg_name;
+    rt_int16_t subscriber_id;
+    rt_uint16_t in_flight;
+    rt_uint16_t arg;
+};
+
+#ifdef TASK_MSG_USING_TRACE
+rt_uint32_t task_msg_trace_stamp(void);
+rt_uint32_t task_msg_trace_stamp_rate(void);
+void task_msg_trace_write(rt_uint8_t event, rt_uint8_t msg_name, rt_int16_t subscriber_id, rt_uint16_t arg);
+rt_uint32_t task_msg_trace_read(struct task_msg_trace_record *records, rt_uint32_t count);
+void task_msg_trace_enable(rt_bool_t enable);
+void task_msg_trace_clear(void);
+void task_msg_trace_dump(rt_bool_t raw);
+#define TASK_MSG_TRACE(event, msg_name, subscriber_id, arg) \
+    task_msg_trace_write(TASK_MSG_TRACE_##event, (rt_uint8_t)(msg_name), (rt_int16_t)(subscriber_id), (rt_uint16_t)(arg))
+#else
+#define TASK_MSG_TRACE(event, msg_name, subscriber_id, arg)
+#endif
+
+#endif /* TASK_MSG_TRACE_H_ */
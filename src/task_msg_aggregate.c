@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+
+#include "task_msg_bus.h"
+#include "task_msg_aggregate.h"
+
+#ifdef TASK_MSG_USING_AGGREGATE
+
+#define DBG_TAG "task.msg.aggregate"
+#define DBG_LVL DBG_INFO
+#include <rtdbg.h>
+
+struct task_msg_aggregate_stage
+{
+    int ref_count;
+    struct task_msg_aggregate config;
+    task_msg_schedule_t schedule;   /* publishes the window at its end */
+    struct rt_mutex lock;           /* the samples and the window end come from different threads */
+    rt_tick_t start;
+    rt_uint32_t count;
+    union
+    {
+        rt_int64_t i64;
+        float f32;
+    } sum;
+    union task_msg_sample min;
+    union task_msg_sample max;
+    rt_uint8_t state[];             /* TASK_MSG_REDUCE_USER */
+};
+typedef struct task_msg_aggregate_stage *task_msg_aggregate_stage_t;
+
+static task_msg_aggregate_stage_t stage_array[TASK_MSG_COUNT];
+
+/**
+ * Take a reference of the stage of the message name, a callback still running after the stage
+ * has been replaced keeps it valid.
+ *
+ * @param msg_name: message name
+ * @return the stage, RT_NULL if there is none
+ */
+static task_msg_aggregate_stage_t stage_take(enum task_msg_name msg_name)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    task_msg_aggregate_stage_t stage = stage_array[msg_name];
+    if (stage)
+    {
+        stage->ref_count++;
+    }
+    rt_hw_interrupt_enable(level);
+    return stage;
+}
+
+static void stage_release(task_msg_aggregate_stage_t stage)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    int ref_count = --stage->ref_count;
+    rt_hw_interrupt_enable(level);
+    if (ref_count == 0)
+    {
+        rt_mutex_detach(&(stage->lock));
+        rt_free(stage);
+    }
+}
+
+/**
+ * Start a new window(the lock must be held).
+ *
+ * @param stage: stage
+ * @param now: current tick
+ */
+static void stage_window_reset(task_msg_aggregate_stage_t stage, rt_tick_t now)
+{
+    stage->start = now;
+    stage->count = 0;
+    rt_memset(&(stage->sum), 0, sizeof(stage->sum));
+    if (stage->config.reducer == TASK_MSG_REDUCE_USER && stage->config.state_size > 0)
+    {
+        rt_memset(stage->state, 0, stage->config.state_size);
+    }
+}
+
+/**
+ * Add a sample to the window of a built-in reducer(the lock must be held).
+ *
+ * @param stage: stage
+ * @param args: sample
+ * @return RT_FALSE if the message object does not hold the number
+ */
+static rt_bool_t stage_sample_add(task_msg_aggregate_stage_t stage, task_msg_args_t args)
+{
+    union task_msg_sample sample;
+    if (args->msg_obj == RT_NULL || args->msg_size < stage->config.sample_offset + sizeof(sample))
+        return RT_FALSE;
+
+    //the number may be unaligned in a packed object
+    rt_memcpy(&sample, (rt_uint8_t *) args->msg_obj + stage->config.sample_offset, sizeof(sample));
+    if (stage->config.sample_type == TASK_MSG_SAMPLE_FLOAT)
+    {
+        stage->sum.f32 += sample.f32;
+        if (stage->count == 0 || sample.f32 < stage->min.f32)
+            stage->min = sample;
+        if (stage->count == 0 || sample.f32 > stage->max.f32)
+            stage->max = sample;
+    }
+    else
+    {
+        stage->sum.i64 += sample.i32;
+        if (stage->count == 0 || sample.i32 < stage->min.i32)
+            stage->min = sample;
+        if (stage->count == 0 || sample.i32 > stage->max.i32)
+            stage->max = sample;
+    }
+    return RT_TRUE;
+}
+
+/**
+ * Reduce the window of a built-in reducer(the lock must be held).
+ *
+ * @param stage: stage
+ * @param window: the message object
+ */
+static void stage_window_fill(task_msg_aggregate_stage_t stage, struct task_msg_window *window)
+{
+    rt_bool_t is_float = (stage->config.sample_type == TASK_MSG_SAMPLE_FLOAT);
+    window->start = stage->start;
+    window->count = stage->count;
+    rt_memset(&(window->value), 0, sizeof(window->value));
+    switch (stage->config.reducer)
+    {
+    case TASK_MSG_REDUCE_AVG:
+        if (stage->count == 0)
+            break;
+        if (is_float)
+            window->value.f32 = stage->sum.f32 / stage->count;
+        else
+            window->value.i32 = (rt_int32_t) (stage->sum.i64 / (rt_int64_t) stage->count);
+        break;
+    case TASK_MSG_REDUCE_MIN:
+        window->value = stage->min;
+        break;
+    case TASK_MSG_REDUCE_MAX:
+        window->value = stage->max;
+        break;
+    case TASK_MSG_REDUCE_SUM:
+        if (is_float)
+            window->value.f32 = stage->sum.f32;
+        else
+            window->value.i32 = (rt_int32_t) stage->sum.i64;
+        break;
+    default:
+        if (is_float)
+            window->value.f32 = (float) stage->count;
+        else
+            window->value.i32 = (rt_int32_t) stage->count;
+        break;
+    }
+    if (stage->count == 0)
+    {
+        rt_memset(&(window->value), 0, sizeof(window->value));
+    }
+}
+
+/**
+ * Consume a raw sample in the dispatching thread, it only updates the window.
+ * @param args: sample
+ */
+static void task_msg_aggregate_callback(task_msg_args_t args)
+{
+    task_msg_aggregate_stage_t stage = stage_take(args->msg_name);
+    if (stage == RT_NULL)
+        return;
+
+    rt_mutex_take(&(stage->lock), RT_WAITING_FOREVER);
+    if (stage->config.reducer == TASK_MSG_REDUCE_USER)
+    {
+        stage->config.reduce(stage->state, args);
+        stage->count++;
+    }
+    else if (stage_sample_add(stage, args))
+    {
+        stage->count++;
+    }
+    rt_mutex_release(&(stage->lock));
+    stage_release(stage);
+}
+
+/**
+ * The produce of the window schedule: make the message of the window which has just ended,
+ * then start the next one. The schedule is deleted before the stage is released.
+ *
+ * @param parameter: stage
+ * @return the message, RT_NULL if there is nothing to publish
+ */
+static task_msg_args_t task_msg_aggregate_produce(void *parameter)
+{
+    task_msg_aggregate_stage_t stage = (task_msg_aggregate_stage_t) parameter;
+    task_msg_args_t args = RT_NULL;
+    rt_tick_t now = rt_tick_get();
+
+    rt_mutex_take(&(stage->lock), RT_WAITING_FOREVER);
+    if (stage->count > 0 || stage->config.publish_empty)
+    {
+        rt_bool_t user = (stage->config.reducer == TASK_MSG_REDUCE_USER);
+        args = task_msg_args_alloc(stage->config.output, user ? stage->config.state_size : sizeof(struct task_msg_window));
+        if (args == RT_NULL)
+        {
+            LOG_W("msg_name[%d] window is dropped! msg_args create failed!", stage->config.output);
+        }
+        else if (user)
+        {
+            if (stage->config.finish)
+            {
+                stage->config.finish(stage->state, stage->count);
+            }
+            if (stage->config.state_size > 0)
+            {
+                rt_memcpy(args->msg_obj, stage->state, stage->config.state_size);
+            }
+        }
+        else
+        {
+            stage_window_fill(stage, (struct task_msg_window *) args->msg_obj);
+        }
+    }
+    stage_window_reset(stage, now);
+    rt_mutex_release(&(stage->lock));
+
+    return args;
+}
+
+/**
+ * Create a stage and start its window schedule.
+ *
+ * @param aggregate: the aggregation
+ * @return the stage, RT_NULL if failed
+ */
+static task_msg_aggregate_stage_t stage_create(const struct task_msg_aggregate *aggregate)
+{
+    rt_size_t state_size = aggregate->reducer == TASK_MSG_REDUCE_USER ? aggregate->state_size : 0;
+    task_msg_aggregate_stage_t stage = rt_calloc(1, sizeof(struct task_msg_aggregate_stage) + state_size);
+    if (stage == RT_NULL)
+        return RT_NULL;
+
+    stage->ref_count = 1;
+    stage->config = *aggregate;
+    stage->start = rt_tick_get();
+    rt_mutex_init(&(stage->lock), "msg_agg", RT_IPC_FLAG_FIFO);
+    stage->schedule = task_msg_schedule_create_producer(aggregate->output, task_msg_aggregate_produce, stage);
+    if (stage->schedule == RT_NULL
+            || task_msg_schedule_start(stage->schedule, aggregate->window_ms, 0, aggregate->window_ms) != RT_EOK)
+    {
+        task_msg_schedule_delete(stage->schedule);
+        stage_release(stage);
+        return RT_NULL;
+    }
+
+    return stage;
+}
+
+/**
+ * Attach an aggregation stage to a message name: its messages are consumed as samples
+ * in the dispatching thread, and only one message per window is published on the output message name,
+ * so the subscribers of the output are woken up once per window instead of once per sample.
+ * The subscribers of the message name itself still receive every sample.
+ *
+ * @param msg_name: message name of the samples
+ * @param aggregate: the aggregation(RT_NULL:detach the stage), the window being reduced is dropped
+ *                   when it is replaced
+ * @return error code
+ */
+rt_err_t task_msg_aggregate_set(enum task_msg_name msg_name, const struct task_msg_aggregate *aggregate)
+{
+    if (msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+    if (aggregate)
+    {
+        if (aggregate->output >= TASK_MSG_COUNT || aggregate->output == msg_name || aggregate->window_ms <= 0
+                || aggregate->reducer > TASK_MSG_REDUCE_USER || aggregate->sample_type > TASK_MSG_SAMPLE_FLOAT)
+            return -RT_EINVAL;
+        if (aggregate->reducer == TASK_MSG_REDUCE_USER && aggregate->reduce == RT_NULL)
+            return -RT_EINVAL;
+    }
+
+    task_msg_aggregate_stage_t stage = RT_NULL;
+    if (aggregate)
+    {
+        stage = stage_create(aggregate);
+        if (stage == RT_NULL)
+        {
+            LOG_E("msg_name[%d] aggregation stage create failed!", msg_name);
+            return -RT_ENOMEM;
+        }
+    }
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    task_msg_aggregate_stage_t old_stage = stage_array[msg_name];
+    stage_array[msg_name] = stage;
+    rt_hw_interrupt_enable(level);
+
+    rt_err_t rst = RT_EOK;
+    if (stage && old_stage == RT_NULL)
+    {
+        //before the other callbacks, so the window is up to date when they run
+        rst = task_msg_subscribe_priority(msg_name, task_msg_aggregate_callback, 0);
+        if (rst != RT_EOK)
+        {
+            level = rt_hw_interrupt_disable();
+            stage_array[msg_name] = RT_NULL;
+            rt_hw_interrupt_enable(level);
+            old_stage = stage;
+        }
+    }
+    else if (stage == RT_NULL && old_stage)
+    {
+        task_msg_unsubscribe(msg_name, task_msg_aggregate_callback);
+    }
+
+    if (old_stage)
+    {
+        //no produce runs once it returns
+        task_msg_schedule_delete(old_stage->schedule);
+        stage_release(old_stage);
+    }
+
+    return rst;
+}
+
+#endif
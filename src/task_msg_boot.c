@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+
+#include "task_msg_bus.h"
+#include "task_msg_boot.h"
+
+#ifdef TASK_MSG_USING_BOOT
+
+#define DBG_TAG "task.msg.boot"
+#define DBG_LVL DBG_INFO
+#include <rtdbg.h>
+
+#ifndef TASK_MSG_BOOT_THREAD_STACK_SIZE
+#define TASK_MSG_BOOT_THREAD_STACK_SIZE 512     /* msg_boot: creates the threads of the ready services */
+#endif
+#ifndef TASK_MSG_BOOT_THREAD_PRIORITY
+#define TASK_MSG_BOOT_THREAD_PRIORITY 10
+#endif
+
+/* a service waiting for one of its readiness message names */
+struct task_msg_service_depend
+{
+    task_msg_service_t service;
+    struct task_msg_service_depend *next;
+};
+
+static task_msg_service_t service_list = RT_NULL;
+static task_msg_service_t *service_tail = &service_list;
+static rt_uint32_t boot_topic[(TASK_MSG_COUNT + 31) / 32];     /* subscribed by task_msg_boot_callback */
+static struct task_msg_service_depend *depend_array[TASK_MSG_COUNT];   /* the services waiting for each message name */
+static task_msg_service_t start_list = RT_NULL;                /* the ready services, started by msg_boot */
+static task_msg_service_t *start_tail = &start_list;
+static struct rt_semaphore boot_sem;
+static rt_bool_t boot_init_tag = RT_FALSE;
+
+/**
+ * Check whether a readiness message name has been published, it stays ready afterwards,
+ * so it does not matter whether the message was published before or after the check.
+ *
+ * @param msg_name: message name
+ * @return RT_TRUE if it is ready
+ */
+rt_bool_t task_msg_ready(enum task_msg_name msg_name)
+{
+    return task_msg_last_seq(msg_name) != 0;
+}
+
+static rt_bool_t task_msg_ready_all(const enum task_msg_name *msg_name_list, rt_uint8_t msg_name_list_len)
+{
+    for (int i = 0; i < msg_name_list_len; i++)
+    {
+        if (!task_msg_ready(msg_name_list[i]))
+            return RT_FALSE;
+    }
+    return RT_TRUE;
+}
+
+/**
+ * Queue a service whose dependencies are all ready, its thread is created by msg_boot
+ * instead of the msg_bus thread which found it ready.
+ * @param service: service
+ */
+static void service_ready(task_msg_service_t service)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    service->start_next = RT_NULL;
+    *start_tail = service;
+    start_tail = &(service->start_next);
+    rt_hw_interrupt_enable(level);
+    rt_sem_release(&boot_sem);
+}
+
+/**
+ * Start the thread of a ready service.
+ * @param service: service
+ */
+static void service_start(task_msg_service_t service)
+{
+    //every message name it waited for has unlinked its node
+    if (service->depend_nodes)
+    {
+        rt_free(service->depend_nodes);
+        service->depend_nodes = RT_NULL;
+    }
+    service->state = TASK_MSG_SERVICE_STARTED;
+    service->start_tick = rt_tick_get();
+    rt_thread_t thread = rt_thread_create(service->name, service->entry, service->parameter, service->stack_size,
+            service->priority, service->tick);
+    if (thread == RT_NULL || rt_thread_startup(thread) != RT_EOK)
+    {
+        service->state = TASK_MSG_SERVICE_FAILED;
+        LOG_E("service %s start failed!", service->name);
+        return;
+    }
+    LOG_D("service %s started at tick %d", service->name, service->start_tick);
+}
+
+static void task_msg_boot_thread_entry(void *params)
+{
+    while (1)
+    {
+        rt_sem_take(&boot_sem, RT_WAITING_FOREVER);
+        while (1)
+        {
+            rt_base_t level = rt_hw_interrupt_disable();
+            task_msg_service_t service = start_list;
+            if (service)
+            {
+                start_list = service->start_next;
+                if (start_list == RT_NULL)
+                {
+                    start_tail = &start_list;
+                }
+            }
+            rt_hw_interrupt_enable(level);
+            if (service == RT_NULL)
+                break;
+
+            service_start(service);
+        }
+    }
+}
+
+/**
+ * Count down the services waiting for the published message name, only the services indexed by it are visited.
+ */
+static void task_msg_boot_callback(task_msg_args_t args)
+{
+    //the message name stays ready, so its waiting services are unlinked once
+    rt_base_t level = rt_hw_interrupt_disable();
+    struct task_msg_service_depend *node = depend_array[args->msg_name];
+    depend_array[args->msg_name] = RT_NULL;
+    rt_hw_interrupt_enable(level);
+
+    while (node)
+    {
+        //the node may be freed by msg_boot as soon as its service is ready
+        struct task_msg_service_depend *next = node->next;
+        task_msg_service_t service = node->service;
+        level = rt_hw_interrupt_disable();
+        rt_bool_t ready = (--service->unmet == 0);
+        rt_hw_interrupt_enable(level);
+        if (ready)
+        {
+            service_ready(service);
+        }
+        node = next;
+    }
+}
+
+/**
+ * Subscribe task_msg_boot_callback to the readiness message names of a service.
+ *
+ * @param service: service
+ * @return error code
+ */
+static rt_err_t service_track(task_msg_service_t service)
+{
+    rt_err_t rst = RT_EOK;
+    for (int i = 0; i < service->depends_count; i++)
+    {
+        enum task_msg_name msg_name = service->depends[i];
+        rt_base_t level = rt_hw_interrupt_disable();
+        rt_bool_t tracked = (boot_topic[msg_name / 32] >> (msg_name % 32)) & 1;
+        boot_topic[msg_name / 32] |= 1UL << (msg_name % 32);
+        rt_hw_interrupt_enable(level);
+        if (!tracked && (rst = task_msg_subscribe(msg_name, task_msg_boot_callback)) != RT_EOK)
+        {
+            level = rt_hw_interrupt_disable();
+            boot_topic[msg_name / 32] &= ~(1UL << (msg_name % 32));
+            rt_hw_interrupt_enable(level);
+            LOG_E("service %s can not track msg_name[%d]!", service->name, msg_name);
+        }
+    }
+    return rst;
+}
+
+/**
+ * Link a tracked service to the message names it still waits for and count them,
+ * a service waiting for none is started at once.
+ *
+ * @param service: service
+ * @return error code
+ */
+static rt_err_t service_index(task_msg_service_t service)
+{
+    struct task_msg_service_depend *nodes = RT_NULL;
+    if (service->depends_count > 0)
+    {
+        nodes = rt_calloc(service->depends_count, sizeof(struct task_msg_service_depend));
+        if (nodes == RT_NULL)
+        {
+            service->state = TASK_MSG_SERVICE_FAILED;
+            LOG_E("service %s start failed! there is no memory available!", service->name);
+            return -RT_ENOMEM;
+        }
+    }
+    service->depend_nodes = nodes;
+
+    //a message name published before this is not counted, one published after it unlinks the node
+    rt_base_t level = rt_hw_interrupt_disable();
+    for (int i = 0; i < service->depends_count; i++)
+    {
+        enum task_msg_name msg_name = service->depends[i];
+        if (task_msg_ready(msg_name))
+            continue;
+        nodes[i].service = service;
+        nodes[i].next = depend_array[msg_name];
+        depend_array[msg_name] = &nodes[i];
+        service->unmet++;
+    }
+    rt_bool_t ready = (service->unmet == 0);
+    rt_hw_interrupt_enable(level);
+    if (ready)
+    {
+        service_ready(service);
+    }
+
+    return RT_EOK;
+}
+
+/**
+ * Register a service, its thread is started as soon as every message name it depends on
+ * has been published(at once if they already have been), independent services start in parallel.
+ * It can be called from any init stage, the services registered before INIT_ENV_EXPORT are started from there.
+ *
+ * @param service: service, it must stay valid and be registered only once
+ * @return error code
+ */
+rt_err_t task_msg_service_register(task_msg_service_t service)
+{
+    if (service == RT_NULL || service->entry == RT_NULL || (service->depends_count > 0 && service->depends == RT_NULL))
+        return -RT_EINVAL;
+    for (int i = 0; i < service->depends_count; i++)
+    {
+        if (service->depends[i] >= TASK_MSG_COUNT)
+            return -RT_EINVAL;
+    }
+
+    service->state = TASK_MSG_SERVICE_WAITING;
+    service->start_tick = 0;
+    service->unmet = 0;
+    service->depend_nodes = RT_NULL;
+    service->next = RT_NULL;
+    rt_base_t level = rt_hw_interrupt_disable();
+    *service_tail = service;
+    service_tail = &(service->next);
+    rt_bool_t tracked = boot_init_tag;
+    rt_hw_interrupt_enable(level);
+    if (!tracked)
+        return RT_EOK;
+
+    //track before indexing, so a message published in between still counts down
+    rt_err_t rst = service_track(service);
+    rt_err_t index_rst = service_index(service);
+
+    return rst != RT_EOK ? rst : index_rst;
+}
+
+/**
+ * Blocks the current thread until all the readiness message names have been published,
+ * instead of delaying for a fixed time.
+ *
+ * @param msg_name_list: message name array
+ * @param msg_name_list_len: message name array length
+ * @param timeout_ms: the waiting millisecond (-1:waiting forever until get resource)
+ * @return error code
+ */
+rt_err_t task_msg_ready_wait(const enum task_msg_name *msg_name_list, rt_uint8_t msg_name_list_len,
+        rt_int32_t timeout_ms)
+{
+    if (msg_name_list == RT_NULL && msg_name_list_len > 0)
+        return -RT_EINVAL;
+
+    rt_err_t rst = RT_EOK;
+    task_msg_subscriber_t subscriber = RT_NULL;
+    rt_int32_t timeout = rt_tick_from_millisecond(timeout_ms);
+    rt_tick_t start = rt_tick_get();
+    while (!task_msg_ready_all(msg_name_list, msg_name_list_len))
+    {
+        if (subscriber == RT_NULL)
+        {
+            //subscribe before checking again, so a message published in between is not missed
+            subscriber = task_msg_subscriber_open(msg_name_list, msg_name_list_len);
+            if (subscriber == RT_NULL)
+            {
+                rst = -RT_ENOMEM;
+                break;
+            }
+            continue;
+        }
+
+        rt_int32_t wait_ms = RT_WAITING_FOREVER;
+        if (timeout >= 0)
+        {
+            rt_tick_t elapsed = rt_tick_get() - start;
+            if (elapsed >= (rt_tick_t) timeout)
+            {
+                rst = -RT_ETIMEOUT;
+                break;
+            }
+            wait_ms = (rt_int32_t) (((rt_uint64_t) (timeout - elapsed) * 1000 + RT_TICK_PER_SECOND - 1)
+                    / RT_TICK_PER_SECOND);
+        }
+        task_msg_args_t args;
+        rt_err_t wait_rst = task_msg_subscriber_wait(subscriber, wait_ms, &args);
+        if (wait_rst == RT_EOK)
+        {
+            task_msg_release(args);
+        }
+        else if (wait_rst != -RT_ETIMEOUT)
+        {
+            rst = wait_rst;
+            break;
+        }
+    }
+    task_msg_subscriber_close(subscriber);
+
+    return rst;
+}
+
+/**
+ * Print the services, their start ticks and the message names they are still waiting for.
+ */
+void task_msg_boot_dump(void)
+{
+    static const char *state_name[] = { "waiting", "started", "failed" };
+
+    rt_kprintf("%-*.*s state   start_tick waiting_for\n", RT_NAME_MAX, RT_NAME_MAX, "service");
+    for (task_msg_service_t service = service_list; service; service = service->next)
+    {
+        rt_kprintf("%-*.*s %-7s ", RT_NAME_MAX, RT_NAME_MAX, service->name, state_name[service->state]);
+        if (service->state == TASK_MSG_SERVICE_WAITING)
+            rt_kprintf("%-10s", "-");
+        else
+            rt_kprintf("%-10d", service->start_tick);
+        for (int i = 0; i < service->depends_count; i++)
+        {
+            if (!task_msg_ready(service->depends[i]))
+                rt_kprintf(" %d", service->depends[i]);
+        }
+        rt_kprintf("\n");
+    }
+}
+
+/**
+ * Start tracking the services registered during the earlier init stages, the bus has been initialized
+ * and has published the messages kept before it.
+ */
+static int task_msg_boot_init(void)
+{
+    rt_sem_init(&boot_sem, "msg_boot", 0, RT_IPC_FLAG_FIFO);
+    rt_thread_t thread = rt_thread_create("msg_boot", task_msg_boot_thread_entry, RT_NULL,
+            TASK_MSG_BOOT_THREAD_STACK_SIZE, TASK_MSG_BOOT_THREAD_PRIORITY, 20);
+    if (thread == RT_NULL)
+    {
+        LOG_E("task msg boot initialize failed! msg_boot_thread create failed!");
+        return -RT_ENOMEM;
+    }
+    rt_thread_startup(thread);
+
+    //the services registered from now on track and index themselves
+    rt_base_t level = rt_hw_interrupt_disable();
+    boot_init_tag = RT_TRUE;
+    task_msg_service_t *end = service_tail;
+    rt_hw_interrupt_enable(level);
+
+    for (task_msg_service_t *link = &service_list; link != end; link = &((*link)->next))
+    {
+        service_track(*link);
+    }
+    for (task_msg_service_t *link = &service_list; link != end; link = &((*link)->next))
+    {
+        service_index(*link);
+    }
+
+    return RT_EOK;
+}
+INIT_ENV_EXPORT(task_msg_boot_init);
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+static int task_msg_boot(int argc, char **argv)
+{
+    task_msg_boot_dump();
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(task_msg_boot, task msg bus services and the readiness message names they wait for);
+#endif
+
+#endif
@@ -9,470 +9,2827 @@
  */
 
 #include "task_msg_bus.h"
+#include "task_msg_trace.h"
+#include "task_msg_record.h"
 
 #define DBG_TAG "task.msg.bus"
 #define DBG_LVL DBG_LOG
 #include <rtdbg.h>
 
 #ifndef TASK_MSG_THREAD_STACK_SIZE
-#define TASK_MSG_THREAD_STACK_SIZE 384
+#define TASK_MSG_THREAD_STACK_SIZE 1024     /* msg_bus: runs the callbacks of the queued messages */
+#endif
+#ifndef TASK_MSG_MB_THREAD_STACK_SIZE
+#define TASK_MSG_MB_THREAD_STACK_SIZE 1024  /* msg_mb: runs the produce of the schedules and the direct callbacks */
 #endif
 #ifndef TASK_MSG_THREAD_PRIORITY
 #define TASK_MSG_THREAD_PRIORITY 5
 #endif
+#ifndef TASK_MSG_SCHEDULE_BURST_MAX
+#define TASK_MSG_SCHEDULE_BURST_MAX 8   /* TASK_MSG_CATCHUP_BURST: the most missed periods published at once */
+#endif
+#ifndef TASK_MSG_WAIT_SPIN
+#define TASK_MSG_WAIT_SPIN 200     /* SMP only: polls for a pending message before sleeping */
+#endif
+#ifndef TASK_MSG_EARLY_BUFFER_SIZE
+#ifdef TASK_MSG_USING_BOOT
+#define TASK_MSG_EARLY_BUFFER_SIZE 256  /* bytes for the messages published before task_msg_bus_init(0:none) */
+#else
+#define TASK_MSG_EARLY_BUFFER_SIZE 0
+#endif
+#endif
 
 //#define TASK_MSG_USING_DYNAMIC_MEMORY
 
+#define TASK_MSG_TOPIC_WORDS ((TASK_MSG_COUNT + 31) / 32)
+
+/* the sequence tracking of a subscribed message name, see task_msg_subscriber_gap */
+struct task_msg_subscriber_seq
+{
+    rt_uint32_t last_seq;
+    rt_uint32_t gap;
+};
+
+struct task_msg_subscriber
+{
+    int subscriber_id;
+    int ref_count;          /* the handle and each subscriber set hold one */
+    rt_uint8_t priority;    /* the smaller the earlier the message is handed to it */
+    rt_uint8_t deleted;
+    rt_uint8_t interrupted; /* see task_msg_subscriber_interrupt */
+    rt_uint8_t waiting;     /* a thread is in task_msg_subscriber_wait, only one may wait at a time */
+    rt_uint8_t wake_timer_active;
+    rt_uint32_t topic[TASK_MSG_TOPIC_WORDS];    /* bitmap of the subscribed message names */
+    struct task_msg_subscriber_seq *seq;        /* one per subscribed message name, in the bitmap order */
+    struct rt_completion done;  /* wakes up the waiting thread, the pending list is the count */
+    rt_uint32_t wake_batch;     /* >1: wake up once this many messages are pending */
+    rt_timer_t wake_timer;      /* bounds the latency of a coalesced wakeup */
+    rt_event_t event;
+    rt_uint32_t event_set;
+    rt_list_t pending;      /* the wait nodes of this subscriber */
+    rt_uint32_t pending_count;
+    rt_uint32_t pending_bytes;
+    rt_slist_t slist;       /* in the slist:msg_subscriber_slist */
+    struct task_msg_subscriber_seq seq_init[];  /* seq of the message names given when it is opened */
+};
+
 static rt_bool_t task_msg_bus_init_tag = RT_FALSE;
 static struct rt_mailbox msg_mb;
 static rt_uint8_t mbpool[128];
 static struct rt_semaphore msg_sem;
 static struct rt_mutex msg_lock;
 static struct rt_mutex msg_tlck;
-static struct rt_mutex msg_ref_lock;
+static struct rt_mutex msg_plck;    /* held by the msg_mb thread while the producers of the schedules run */
 static struct rt_mutex cb_lock;
 static struct rt_mutex sub_lock;
-static struct rt_mutex wt_lock;
-static rt_slist_t callback_slist_array[TASK_MSG_COUNT];
+static struct rt_mutex dec_lock;
+static task_msg_callback_set_t callback_set_array[TASK_MSG_COUNT];
+static task_msg_subscriber_set_t subscriber_set_array[TASK_MSG_COUNT];
+static rt_bool_t direct_publish_array[TASK_MSG_COUNT];
+static rt_tick_t ttl_array[TASK_MSG_COUNT];
+static struct task_msg_stats stats_array[TASK_MSG_COUNT];
+static rt_uint32_t seq_array[TASK_MSG_COUNT];
+static rt_size_t mem_budget = 0;
+static rt_size_t mem_used = 0;
+static struct task_msg_policy_state
+{
+    rt_bool_t enabled;
+    rt_uint32_t rate;
+    rt_uint32_t burst;
+    rt_uint32_t tokens;             /* 1 token = RT_TICK_PER_SECOND */
+    rt_tick_t refill_tick;
+    rt_tick_t min_interval;
+    rt_tick_t last_tick;
+    rt_bool_t has_last;
+    rt_int32_t debounce_ms;
+    rt_bool_t debounce_pending;
+} policy_array[TASK_MSG_COUNT];
+static struct task_msg_decoder
+{
+    void *(*decode)(task_msg_args_t args);
+    void (*release)(void *decoded);
+} decoder_array[TASK_MSG_COUNT];
 #ifdef TASK_MSG_USING_DYNAMIC_MEMORY
 static struct task_msg_dup_release_hook dup_release_hooks[TASK_MSG_COUNT] = task_msg_dup_release_hooks;
 #endif
 static rt_slist_t msg_slist = RT_SLIST_OBJECT_INIT(msg_slist);
-static rt_slist_t msg_ref_slist = RT_SLIST_OBJECT_INIT(msg_ref_slist);
 static rt_slist_t msg_subscriber_slist = RT_SLIST_OBJECT_INIT(msg_subscriber_slist);
-static rt_slist_t msg_wait_slist = RT_SLIST_OBJECT_INIT(msg_wait_slist);
 static rt_slist_t msg_timer_slist = RT_SLIST_OBJECT_INIT(msg_timer_slist);
+static task_msg_timer_node_t scheduled_array[TASK_MSG_COUNT];   /* the schedules of task_msg_scheduled_xxx */
+static task_msg_timer_node_t debounce_array[TASK_MSG_COUNT];
 static rt_uint32_t subscriber_id = 0;
+static rt_uint32_t msg_in_flight = 0;
+#if TASK_MSG_EARLY_BUFFER_SIZE > 0
+/* a message published before task_msg_bus_init, followed by its object */
+struct task_msg_early_record
+{
+    rt_uint16_t msg_name;
+    rt_uint16_t msg_size;
+};
+static rt_uint32_t early_buffer[(TASK_MSG_EARLY_BUFFER_SIZE + 3) / 4];
+static rt_size_t early_used = 0;
+#endif
 
 /**
- * Append a message reference to the slist:msg_ref_slist,
- * each message reference are added only once.
+ * Get the bytes a message holds: the args, the message object and what its dup hook allocates.
  *
- * @param args: message reference
+ * @param msg_name: message name
+ * @param msg_obj: message object(the publisher's or the bus-owned one)
+ * @param msg_size: message size
+ * @return bytes
  */
-static void msg_ref_append(task_msg_args_t args)
+static rt_size_t task_msg_args_bytes(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
 {
-    rt_bool_t is_first_append = RT_TRUE;
-    task_msg_ref_node_t item;
-    rt_mutex_take(&msg_ref_lock, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(item, &msg_ref_slist, slist)
-    {
-        if (item->args == args)
-        {
-            is_first_append = RT_FALSE;
-            item->ref_count++;
-            break;
-        }
-    }
-    if (is_first_append)
+    rt_size_t bytes = sizeof(struct task_msg_args);
+    if (msg_obj && msg_size > 0)
     {
-        task_msg_ref_node_t node = rt_calloc(1, sizeof(struct task_msg_ref_node));
-        if (node == RT_NULL)
+        bytes += msg_size;
+#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
+        if (dup_release_hooks[msg_name].size)
         {
-            rt_mutex_release(&msg_ref_lock);
-            LOG_E("there is no memory available!");
-            return;
+            bytes += dup_release_hooks[msg_name].size(msg_obj);
         }
-        node->args = args;
-        node->ref_count = 1;
-        rt_slist_init(&(node->slist));
-        rt_slist_append(&msg_ref_slist, &(node->slist));
+#endif
     }
-    rt_mutex_release(&msg_ref_lock);
+    return bytes;
 }
 
 /**
- * Release a message reference from the slist:msg_ref_slist,
- * only when the subscribers of all messages have consumed,
- * can they really free from memory.
+ * Charge bytes to the memory budgets of the message name and of the bus.
  *
- * @param args: message reference
+ * @param msg_name: message name
+ * @param bytes: bytes to be allocated
+ * @param enforce: RT_TRUE:fail if a budget would be exceeded
+ * @return RT_TRUE:charged
  */
-void task_msg_release(task_msg_args_t args)
+static rt_bool_t task_msg_mem_charge(enum task_msg_name msg_name, rt_size_t bytes, rt_bool_t enforce)
 {
-    task_msg_ref_node_t item;
-    rt_mutex_take(&msg_ref_lock, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(item, &msg_ref_slist, slist)
+    struct task_msg_stats *stats = &stats_array[msg_name];
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (enforce && ((stats->budget > 0 && stats->bytes + bytes > stats->budget)
+            || (mem_budget > 0 && mem_used + bytes > mem_budget)))
     {
-        if (item->args == args)
-        {
-            item->ref_count--;
-            if (item->ref_count <= 0)
-            {
-                rt_slist_remove(&msg_ref_slist, &(item->slist));
-                if (item->args->msg_obj)
-                {
-#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
-                    if (dup_release_hooks[item->args->msg_name].release)
-                    {
-                        RT_ASSERT(dup_release_hooks[item->args->msg_name].msg_name == item->args->msg_name);
-                        dup_release_hooks[item->args->msg_name].release(item->args->msg_obj);
-                    }
-#endif
-                    rt_free(item->args->msg_obj);
-                }
-                rt_free(item->args);
-                rt_free(item);
-            }
-            break;
-        }
+        stats->rejected++;
+        rt_hw_interrupt_enable(level);
+        TASK_MSG_TRACE(DROP, msg_name, -1, 0);
+        return RT_FALSE;
     }
-    rt_mutex_release(&msg_ref_lock);
+    stats->bytes += bytes;
+    mem_used += bytes;
+    rt_hw_interrupt_enable(level);
+    return RT_TRUE;
 }
 
 /**
- * Create a subscriber.
+ * Return bytes to the memory budgets of the message name and of the bus.
+ *
  * @param msg_name: message name
- * @return create failed return -1,otherwise return >=0
+ * @param bytes: freed bytes
  */
-int task_msg_subscriber_create(enum task_msg_name msg_name)
+static void task_msg_mem_uncharge(enum task_msg_name msg_name, rt_size_t bytes)
 {
-    if (task_msg_bus_init_tag == RT_FALSE)
-        return -1;
-
-    task_msg_subscriber_node_t subscriber = (task_msg_subscriber_node_t) rt_calloc(1,
-            sizeof(struct task_msg_subscriber_node));
-    if (subscriber == RT_NULL)
-        return -1;
-
-    int id = subscriber_id++;
-    char name[RT_NAME_MAX];
-    rt_snprintf(name, RT_NAME_MAX, "sub_%d", id);
-    subscriber->sem = rt_sem_create(name, 0, RT_IPC_FLAG_PRIO);
-    if (subscriber->sem == RT_NULL)
-    {
-        rt_free(subscriber);
-        return -1;
-    }
-
-    subscriber->msg_name = msg_name;
-    subscriber->subscriber_id = id;
-    rt_slist_init(&(subscriber->slist));
-    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
-    rt_slist_append(&msg_subscriber_slist, &(subscriber->slist));
-    rt_mutex_release(&sub_lock);
-
-    return id;
+    rt_base_t level = rt_hw_interrupt_disable();
+    stats_array[msg_name].bytes -= bytes;
+    mem_used -= bytes;
+    rt_hw_interrupt_enable(level);
 }
 
 /**
- * Create a subscriber and allow multiple topics to be subscribed.
- * @param msg_name_list: message name array
- * @param msg_name_list_len: message name array length
- * @return create failed return -1,otherwise return >=0
+ * Free the decoded form of a message, it may refer to the message object so free it first.
+ * @param args: message reference
  */
-int task_msg_subscriber_create2(const enum task_msg_name *msg_name_list, rt_uint8_t msg_name_list_len)
+static void task_msg_args_decoded_free(task_msg_args_t args)
 {
-    if (task_msg_bus_init_tag == RT_FALSE)
-        return -1;
-
-    int id = subscriber_id++;
-    char name[RT_NAME_MAX];
-    rt_snprintf(name, RT_NAME_MAX, "sub_%d", id);
-    rt_sem_t sem = rt_sem_create(name, 0, RT_IPC_FLAG_PRIO);
-    if (sem == RT_NULL)
-        return -1;
-
-    int count = 0;
-    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
-    for (int i = 0; i < msg_name_list_len; i++)
+    if (args->decoded)
     {
-        task_msg_subscriber_node_t subscriber = rt_calloc(1, sizeof(struct task_msg_subscriber_node));
-        if (subscriber == RT_NULL)
+        if (args->decoded_free)
         {
-            goto ERROR;
+            args->decoded_free(args->decoded);
         }
-
-        subscriber->sem = sem;
-        subscriber->msg_name = msg_name_list[i];
-        subscriber->subscriber_id = id;
-        rt_slist_init(&(subscriber->slist));
-        rt_slist_append(&msg_subscriber_slist, &(subscriber->slist));
-        count++;
+        args->decoded = RT_NULL;
+        args->decoded_free = RT_NULL;
     }
+}
 
-    if (count > 0)
+/**
+ * Free a message args and the message object it holds.
+ *
+ * @param args: message reference
+ */
+static void task_msg_args_free(task_msg_args_t args)
+{
+    enum task_msg_name msg_name = args->msg_name;
+    //an attached object is not allocated by the bus
+    rt_size_t bytes = task_msg_args_bytes(msg_name, args->obj_free ? RT_NULL : args->msg_obj, args->msg_size);
+    task_msg_args_decoded_free(args);
+    if (args->obj_free)
     {
-        rt_mutex_release(&sub_lock);
-        return id;
+        args->obj_free(args->msg_obj);
     }
-
-    ERROR: rt_sem_delete(sem);
-    if (count > 0)
+    else if (args->msg_obj)
     {
-        task_msg_subscriber_node_t subscriber;
-        rt_slist_for_each_entry(subscriber, &msg_subscriber_slist, slist)
+#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
+        if (dup_release_hooks[args->msg_name].release)
         {
-            if (subscriber->subscriber_id == id)
-            {
-                rt_slist_remove(&msg_subscriber_slist, &(subscriber->slist));
-                rt_free(subscriber);
-            }
+            RT_ASSERT(dup_release_hooks[args->msg_name].msg_name == args->msg_name);
+            dup_release_hooks[args->msg_name].release(args->msg_obj);
         }
-
+#endif
+        rt_free(args->msg_obj);
     }
-    rt_mutex_release(&sub_lock);
-    return -1;
+    rt_free(args);
+    task_msg_mem_uncharge(msg_name, bytes);
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    msg_in_flight--;
+    rt_hw_interrupt_enable(level);
 }
 
 /**
- * Delete a subscriber.
- * @param subscriber_id: subscriber id
+ * Get the number of messages which have not been freed.
+ * @return message count
  */
-void task_msg_subscriber_delete(int subscriber_id)
+rt_uint32_t task_msg_in_flight(void)
 {
-    task_msg_wait_node_t wait_node;
-    task_msg_subscriber_node_t subscriber;
-    rt_bool_t first_tag = RT_TRUE;
+    return msg_in_flight;
+}
 
-    rt_mutex_take(&wt_lock, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(wait_node, &msg_wait_slist, slist)
-    {
-        if (wait_node->subscriber->subscriber_id == subscriber_id)
-        {
-            rt_slist_remove(&msg_wait_slist, &(wait_node->slist));
-            task_msg_release(wait_node->args);
-            rt_free(wait_node);
-        }
-    }
+/**
+ * Get the sequence number of the last published message of the message name,
+ * a message name which has been published at least once is ready.
+ *
+ * @param msg_name: message name
+ * @return sequence number, 0 if it has never been published
+ */
+rt_uint32_t task_msg_last_seq(enum task_msg_name msg_name)
+{
+    return msg_name < TASK_MSG_COUNT ? seq_array[msg_name] : 0;
+}
 
-    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(subscriber, &msg_subscriber_slist, slist)
+/**
+ * Set the deadline of a message allocated by task_msg_args_alloc, the message is dropped
+ * instead of delivered once the deadline has passed.
+ *
+ * @param args: message reference
+ * @param timeout_ms: the millisecond from now on(0:the time to live of the message name applies when it is published)
+ */
+void task_msg_args_deadline_set(task_msg_args_t args, rt_int32_t timeout_ms)
+{
+    args->deadline = 0;
+    if (timeout_ms > 0)
     {
-        if (subscriber->subscriber_id == subscriber_id)
-        {
-            rt_slist_remove(&msg_subscriber_slist, &(subscriber->slist));
-            if (first_tag)
-            {
-                rt_sem_delete(subscriber->sem);
-                first_tag = RT_FALSE;
-            }
-            rt_free(subscriber);
-        }
+        args->deadline = rt_tick_get() + rt_tick_from_millisecond(timeout_ms);
+        if (args->deadline == 0)
+            args->deadline = 1;
     }
-    rt_mutex_release(&sub_lock);
-    rt_mutex_release(&wt_lock);
 }
 
 /**
- * Blocks the current thread until a message of the specified message name is received.
+ * Set the time to live of the messages of the message name, which is applied when they are published.
  *
- * @param subscriber_id: subscriber id
- * @param timeout_ms: the waiting millisecond (-1:waiting forever until get resource)
- * @param out_args: output parameter, return the received message reference address
+ * @param msg_name: message name
+ * @param ttl_ms: the time to live millisecond(0:never expires)
  * @return error code
  */
-rt_err_t task_msg_wait_until(int subscriber_id, rt_int32_t timeout_ms, struct task_msg_args **out_args)
+rt_err_t task_msg_ttl_set(enum task_msg_name msg_name, rt_int32_t ttl_ms)
 {
-    if (task_msg_bus_init_tag == RT_FALSE)
+    if (msg_name >= TASK_MSG_COUNT || ttl_ms < 0)
         return -RT_EINVAL;
 
-    rt_err_t rst = -RT_ERROR;
-    task_msg_subscriber_node_t subscriber;
-    rt_sem_t sem = RT_NULL;
+    ttl_array[msg_name] = ttl_ms > 0 ? rt_tick_from_millisecond(ttl_ms) : 0;
 
-    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(subscriber, &msg_subscriber_slist, slist)
-    {
-        if (subscriber->subscriber_id == subscriber_id)
-        {
-            sem = subscriber->sem;
-            break;
-        }
-    }
-    rt_mutex_release(&sub_lock);
+    return RT_EOK;
+}
 
-    if (sem == RT_NULL)
-    {
-        rt_thread_mdelay(timeout_ms);
+/**
+ * Set the decoder of the message name, which turns a message(e.g. json text) into the decoded form
+ * on the first task_msg_args_decoded, every consumer of the message shares the decoded form.
+ * Set it before the messages of the message name are published.
+ *
+ * @param msg_name: message name
+ * @param decode: returns the decoded form, RT_NULL if failed(RT_NULL:no decoder)
+ * @param release: frees the decoded form when the message is freed(can be RT_NULL)
+ * @return error code
+ */
+rt_err_t task_msg_decoder_set(enum task_msg_name msg_name, void *(*decode)(task_msg_args_t args),
+        void (*release)(void *decoded))
+{
+    if (msg_name >= TASK_MSG_COUNT)
         return -RT_EINVAL;
-    }
 
-    rst = rt_sem_take(sem, rt_tick_from_millisecond(timeout_ms));
-    if (rst == RT_EOK)
+    rt_base_t level = rt_hw_interrupt_disable();
+    decoder_array[msg_name].decode = decode;
+    decoder_array[msg_name].release = release;
+    rt_hw_interrupt_enable(level);
+
+    return RT_EOK;
+}
+
+/**
+ * Get the decoded form of a message, the decoder of the message name runs once on the first access
+ * and the result is freed with the message(shall not be used in ISR).
+ *
+ * @param args: message reference
+ * @return the decoded form(read only), RT_NULL if the message name has no decoder or the decoding failed
+ */
+void *task_msg_args_decoded(task_msg_args_t args)
+{
+    if (args == RT_NULL || decoder_array[args->msg_name].decode == RT_NULL)
+        return RT_NULL;
+    //it is only written once under dec_lock, and published with interrupts disabled after the decoded form is complete
+    rt_base_t level = rt_hw_interrupt_disable();
+    void *decoded = args->decoded;
+    rt_hw_interrupt_enable(level);
+    if (decoded)
+        return decoded;
+
+    rt_mutex_take(&dec_lock, RT_WAITING_FOREVER);
+    level = rt_hw_interrupt_disable();
+    decoded = args->decoded;
+    void *(*decode)(task_msg_args_t args) = decoder_array[args->msg_name].decode;
+    void (*release)(void *decoded) = decoder_array[args->msg_name].release;
+    rt_hw_interrupt_enable(level);
+    if (decoded == RT_NULL && decode)
     {
-        rst = -RT_EINVAL;
-        task_msg_wait_node_t wait_node;
-        rt_mutex_take(&wt_lock, RT_WAITING_FOREVER);
-        rt_slist_for_each_entry(wait_node, &msg_wait_slist, slist)
-        {
-            if (wait_node->subscriber->subscriber_id == subscriber_id)
-            {
-                *out_args = wait_node->args;
-                rt_slist_remove(&msg_wait_slist, &(wait_node->slist));
-                rt_free(wait_node);
-                rst = RT_EOK;
-                break;
-            }
-        }
-        rt_mutex_release(&wt_lock);
+        decoded = decode(args);
+        //the release function goes with the decoded form, a later task_msg_decoder_set does not change it
+        level = rt_hw_interrupt_disable();
+        args->decoded_free = release;
+        args->decoded = decoded;
+        rt_hw_interrupt_enable(level);
     }
+    rt_mutex_release(&dec_lock);
 
-    return rst;
+    return decoded;
 }
 
 /**
- * Subscribe the message with the specified name and set the callback function.
+ * Set the publish policy of the message name, the messages beyond the rate limit or the minimum interval
+ * are rejected before anything is allocated, and the debounced messages are published by the debounce
+ * schedule of the message name after the quiet period.
  *
  * @param msg_name: message name
- * @param callback: callback function name
+ * @param policy: publish policy(RT_NULL:no limit)
  * @return error code
  */
-rt_err_t task_msg_subscribe(enum task_msg_name msg_name, void (*callback)(task_msg_args_t msg_args))
+rt_err_t task_msg_policy_set(enum task_msg_name msg_name, const struct task_msg_policy *policy)
 {
-    if (task_msg_bus_init_tag == RT_FALSE || callback == RT_NULL)
+    if (msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+    if (policy && (policy->min_interval_ms < 0 || policy->debounce_ms < 0))
         return -RT_EINVAL;
 
-    rt_mutex_take(&cb_lock, RT_WAITING_FOREVER);
-    rt_bool_t find_tag = RT_FALSE;
-    task_msg_callback_node_t node;
-    rt_slist_for_each_entry(node, &callback_slist_array[msg_name], slist)
+    struct task_msg_policy_state state;
+    rt_memset(&state, 0, sizeof(state));
+    if (policy)
     {
-        if (node->callback == callback)
-        {
-            find_tag = RT_TRUE;
-            break;
-        }
+        state.rate = policy->rate;
+        state.burst = policy->burst > 0 ? policy->burst : 1;
+        state.tokens = state.burst * RT_TICK_PER_SECOND;
+        state.refill_tick = rt_tick_get();
+        state.min_interval = rt_tick_from_millisecond(policy->min_interval_ms);
+        state.debounce_ms = policy->debounce_ms;
+        state.enabled = (state.rate > 0 || state.min_interval > 0 || state.debounce_ms > 0);
     }
-    if (find_tag)
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    policy_array[msg_name] = state;
+    rt_hw_interrupt_enable(level);
+
+    return RT_EOK;
+}
+
+enum task_msg_policy_result
+{
+    TASK_MSG_POLICY_PASS = 0,
+    TASK_MSG_POLICY_SUPPRESS,
+    TASK_MSG_POLICY_DEBOUNCE,
+};
+
+/**
+ * Apply the publish policy of the message name to a message about to be published.
+ *
+ * @param msg_name: message name
+ * @return TASK_MSG_POLICY_PASS:publish it now, TASK_MSG_POLICY_SUPPRESS:reject it,
+ *         TASK_MSG_POLICY_DEBOUNCE:hand it to task_msg_debounce
+ */
+static enum task_msg_policy_result task_msg_policy_apply(enum task_msg_name msg_name)
+{
+    enum task_msg_policy_result result = TASK_MSG_POLICY_PASS;
+    struct task_msg_policy_state *state = &policy_array[msg_name];
+    if (!state->enabled)
+        return TASK_MSG_POLICY_PASS;
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    rt_tick_t now = rt_tick_get();
+    if (state->debounce_ms > 0)
     {
-        LOG_W("this task msg callback with msg_name[%d] is exist!", msg_name);
+        result = TASK_MSG_POLICY_DEBOUNCE;
     }
-    else
+    else if (state->min_interval > 0 && state->has_last && now - state->last_tick < state->min_interval)
     {
-        task_msg_callback_node_t callback_node = rt_calloc(1, sizeof(struct task_msg_callback_node));
-        if (callback_node == RT_NULL)
-        {
-            rt_mutex_release(&cb_lock);
-            LOG_E("there is no memory available!");
-            return RT_ENOMEM;
-        }
-        callback_node->callback = callback;
-        rt_slist_init(&(callback_node->slist));
-        rt_slist_append(&callback_slist_array[msg_name], &(callback_node->slist));
+        result = TASK_MSG_POLICY_SUPPRESS;
     }
-    rt_mutex_release(&cb_lock);
+    else if (state->rate > 0)
+    {
+        rt_uint32_t full = state->burst * RT_TICK_PER_SECOND;
+        rt_tick_t elapsed = now - state->refill_tick;
+        state->refill_tick = now;
+        if (elapsed >= full / state->rate || state->tokens + elapsed * state->rate >= full)
+            state->tokens = full;
+        else
+            state->tokens += elapsed * state->rate;
+        if (state->tokens < RT_TICK_PER_SECOND)
+            result = TASK_MSG_POLICY_SUPPRESS;
+        else
+            state->tokens -= RT_TICK_PER_SECOND;
+    }
+    if (result == TASK_MSG_POLICY_PASS)
+    {
+        state->last_tick = now;
+        state->has_last = RT_TRUE;
+    }
+    else if (result == TASK_MSG_POLICY_SUPPRESS)
+    {
+        stats_array[msg_name].suppressed++;
+    }
+    rt_hw_interrupt_enable(level);
+
+    if (result == TASK_MSG_POLICY_SUPPRESS)
+    {
+        TASK_MSG_TRACE(DROP, msg_name, -1, 0);
+    }
+    return result;
+}
+
+/**
+ * Set the memory budget of the message name, a publish which would exceed it fails
+ * before anything is allocated.
+ *
+ * @param msg_name: message name
+ * @param budget: bytes held by the messages and wait nodes of the message name(0:unlimited)
+ * @return error code
+ */
+rt_err_t task_msg_budget_set(enum task_msg_name msg_name, rt_size_t budget)
+{
+    if (msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
+    stats_array[msg_name].budget = budget;
 
     return RT_EOK;
 }
 
 /**
- * Unsubscribe the message with the specified name and cancle the callback function.
+ * Set the memory budget of the whole message bus.
+ * @param budget: bytes held by all the messages and wait nodes(0:unlimited)
+ */
+void task_msg_budget_set_global(rt_size_t budget)
+{
+    mem_budget = budget;
+}
+
+/**
+ * Get the bytes held by all the messages and wait nodes.
+ * @return bytes
+ */
+rt_size_t task_msg_mem_used(void)
+{
+    return mem_used;
+}
+
+/**
+ * Get the statistics of the message name.
  *
  * @param msg_name: message name
- * @param callback: callback function name
+ * @param stats: output parameter
  * @return error code
  */
-rt_err_t task_msg_unsubscribe(enum task_msg_name msg_name, void (*callback)(task_msg_args_t msg_args))
+rt_err_t task_msg_stats_get(enum task_msg_name msg_name, struct task_msg_stats *stats)
 {
-    if (task_msg_bus_init_tag == RT_FALSE || callback == RT_NULL)
+    if (msg_name >= TASK_MSG_COUNT)
         return -RT_EINVAL;
 
-    task_msg_callback_node_t node;
-    rt_mutex_take(&cb_lock, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(node, &callback_slist_array[msg_name], slist)
-    {
-        if (node->callback == callback)
-        {
-            rt_slist_remove(&callback_slist_array[msg_name], &(node->slist));
-            rt_free(node);
-            break;
-        }
-    }
-    rt_mutex_release(&cb_lock);
+    rt_base_t level = rt_hw_interrupt_disable();
+    *stats = stats_array[msg_name];
+    rt_hw_interrupt_enable(level);
 
     return RT_EOK;
 }
 
 /**
- * Publish a message object(shall not be used in ISR).
+ * Check whether the deadline of a message has passed.
+ *
+ * @param args: message reference
+ * @return RT_TRUE:expired
+ */
+static rt_bool_t task_msg_args_expired(task_msg_args_t args)
+{
+    return args->deadline != 0 && (rt_tick_t) (rt_tick_get() - args->deadline) < RT_TICK_MAX / 2;
+}
+
+/**
+ * Count an expired message and release the reference of it.
+ *
+ * @param args: message reference
+ * @param subscriber_id: the subscriber which drops it(-1:dropped at dispatch)
+ */
+static void task_msg_args_expire(task_msg_args_t args, int subscriber_id)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    stats_array[args->msg_name].expired++;
+    rt_hw_interrupt_enable(level);
+
+    TASK_MSG_TRACE(EXPIRE, args->msg_name, subscriber_id, 0);
+    task_msg_release(args);
+}
+
+/**
+ * Release a message reference, only when the subscribers of all messages have consumed,
+ * can they really free from memory.
+ *
+ * @param args: message reference
+ */
+void task_msg_release(task_msg_args_t args)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    int ref_count = --args->ref_count;
+    rt_hw_interrupt_enable(level);
+
+    TASK_MSG_TRACE(RELEASE, args->msg_name, -1, ref_count);
+    if (ref_count == 0)
+    {
+        task_msg_args_free(args);
+    }
+}
+
+/**
+ * Get the priority of the current thread, the lowest one before the scheduler starts.
+ * @return priority
+ */
+static rt_uint8_t task_msg_self_priority(void)
+{
+    rt_thread_t thread = rt_thread_self();
+    return thread ? thread->current_priority : RT_THREAD_PRIORITY_MAX - 1;
+}
+
+/**
+ * Take a reference of the callback set of the message name, the set is immutable
+ * and stays valid until callback_set_release, so it can be walked without any lock.
+ *
+ * @param msg_name: message name
+ * @return the callback set, RT_NULL if there is no callback
+ */
+static task_msg_callback_set_t callback_set_take(enum task_msg_name msg_name)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    task_msg_callback_set_t set = callback_set_array[msg_name];
+    if (set)
+    {
+        set->ref_count++;
+    }
+    rt_hw_interrupt_enable(level);
+    return set;
+}
+
+/**
+ * Release a reference of the callback set, the last reference frees it.
+ *
+ * @param set: callback set
+ */
+static void callback_set_release(task_msg_callback_set_t set)
+{
+    if (set == RT_NULL)
+        return;
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    int ref_count = --set->ref_count;
+    rt_hw_interrupt_enable(level);
+    if (ref_count == 0)
+    {
+        rt_free(set);
+    }
+}
+
+/**
+ * Replace the callback set of the message name(cb_lock must be held).
+ *
+ * @param msg_name: message name
+ * @param set: new callback set
+ */
+static void callback_set_swap(enum task_msg_name msg_name, task_msg_callback_set_t set)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    task_msg_callback_set_t old_set = callback_set_array[msg_name];
+    callback_set_array[msg_name] = set;
+    rt_hw_interrupt_enable(level);
+    callback_set_release(old_set);
+}
+
+/**
+ * Release a reference of the subscriber, the last reference frees it.
+ *
+ * @param subscriber: subscriber handle
+ */
+static void subscriber_release(task_msg_subscriber_t subscriber)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    int ref_count = --subscriber->ref_count;
+    rt_hw_interrupt_enable(level);
+    if (ref_count == 0)
+    {
+        if (subscriber->wake_timer)
+        {
+            rt_timer_delete(subscriber->wake_timer);
+        }
+        if (subscriber->seq != subscriber->seq_init)
+        {
+            rt_free(subscriber->seq);
+        }
+        rt_free(subscriber);
+    }
+}
+
+static int task_msg_bit_count(rt_uint32_t bits)
+{
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Check whether the subscriber subscribes the message name.
+ *
+ * @param subscriber: subscriber handle
+ * @param msg_name: message name
+ * @return RT_TRUE if it is subscribed
+ */
+static rt_bool_t subscriber_topic_test(task_msg_subscriber_t subscriber, enum task_msg_name msg_name)
+{
+    return (subscriber->topic[msg_name / 32] >> (msg_name % 32)) & 1;
+}
+
+/**
+ * Get the count of the message names subscribed before the message name, that is its index in subscriber->seq.
+ *
+ * @param subscriber: subscriber handle
+ * @param msg_name: message name(TASK_MSG_COUNT:the count of all)
+ * @return index
+ */
+static int subscriber_topic_rank(task_msg_subscriber_t subscriber, enum task_msg_name msg_name)
+{
+    int rank = 0;
+    for (int i = 0; i < (int) msg_name / 32; i++)
+    {
+        rank += task_msg_bit_count(subscriber->topic[i]);
+    }
+    if (msg_name % 32)
+    {
+        rank += task_msg_bit_count(subscriber->topic[msg_name / 32] & ((1UL << (msg_name % 32)) - 1));
+    }
+    return rank;
+}
+
+/**
+ * Wake up the thread waiting for the subscriber and its bound event.
+ * @param subscriber: subscriber handle
+ */
+static void subscriber_notify(task_msg_subscriber_t subscriber)
+{
+    rt_completion_done(&(subscriber->done));
+    if (subscriber->event)
+    {
+        rt_event_send(subscriber->event, subscriber->event_set);
+    }
+}
+
+static void subscriber_wakeup_timeout(void *params)
+{
+    task_msg_subscriber_t subscriber = (task_msg_subscriber_t) params;
+    rt_base_t level = rt_hw_interrupt_disable();
+    subscriber->wake_timer_active = RT_FALSE;
+    rt_hw_interrupt_enable(level);
+    subscriber_notify(subscriber);
+}
+
+enum task_msg_wakeup_result
+{
+    TASK_MSG_WAKEUP_NONE = 0,
+    TASK_MSG_WAKEUP_NOW,
+    TASK_MSG_WAKEUP_LATER,
+};
+
+/**
+ * Decide whether the pending messages of the subscriber wake it up now(interrupts must be disabled).
+ *
+ * @param subscriber: subscriber handle
+ * @param arrival: RT_TRUE:a message has just been queued, only the one completing a batch wakes it up,
+ *                 the subscriber drains the rest before it sleeps again
+ * @return TASK_MSG_WAKEUP_NOW:call subscriber_wakeup, TASK_MSG_WAKEUP_LATER:start the wakeup timer,
+ *         TASK_MSG_WAKEUP_NONE:nothing to do
+ */
+static enum task_msg_wakeup_result subscriber_wakeup_check(task_msg_subscriber_t subscriber, rt_bool_t arrival)
+{
+    if (subscriber->pending_count == 0)
+        return TASK_MSG_WAKEUP_NONE;
+    if (subscriber->wake_batch <= 1 || subscriber->pending_count == subscriber->wake_batch)
+        return TASK_MSG_WAKEUP_NOW;
+    if (subscriber->pending_count > subscriber->wake_batch)
+        return arrival ? TASK_MSG_WAKEUP_NONE : TASK_MSG_WAKEUP_NOW;
+    if (subscriber->wake_timer_active)
+        return TASK_MSG_WAKEUP_NONE;
+
+    subscriber->wake_timer_active = RT_TRUE;
+    return TASK_MSG_WAKEUP_LATER;
+}
+
+/**
+ * Act on the result of subscriber_wakeup_check.
+ *
+ * @param subscriber: subscriber handle
+ * @param result: the result of subscriber_wakeup_check
+ */
+static void subscriber_wakeup(task_msg_subscriber_t subscriber, enum task_msg_wakeup_result result)
+{
+    if (result == TASK_MSG_WAKEUP_LATER)
+    {
+        rt_timer_start(subscriber->wake_timer);
+    }
+    else if (result == TASK_MSG_WAKEUP_NOW)
+    {
+        rt_base_t level = rt_hw_interrupt_disable();
+        rt_bool_t active = subscriber->wake_timer_active;
+        subscriber->wake_timer_active = RT_FALSE;
+        rt_hw_interrupt_enable(level);
+        if (active)
+        {
+            rt_timer_stop(subscriber->wake_timer);
+        }
+        subscriber_notify(subscriber);
+    }
+}
+
+/**
+ * Take a reference of the subscriber set of the message name, the set is immutable
+ * and stays valid until subscriber_set_release, so it can be walked without any lock.
+ *
+ * @param msg_name: message name
+ * @return the subscriber set, RT_NULL if there is no subscriber
+ */
+static task_msg_subscriber_set_t subscriber_set_take(enum task_msg_name msg_name)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    task_msg_subscriber_set_t set = subscriber_set_array[msg_name];
+    if (set)
+    {
+        set->ref_count++;
+    }
+    rt_hw_interrupt_enable(level);
+    return set;
+}
+
+/**
+ * Release a reference of the subscriber set, the last reference frees it
+ * and releases the subscriber nodes it holds.
+ *
+ * @param set: subscriber set
+ */
+static void subscriber_set_release(task_msg_subscriber_set_t set)
+{
+    if (set == RT_NULL)
+        return;
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    int ref_count = --set->ref_count;
+    rt_hw_interrupt_enable(level);
+    if (ref_count == 0)
+    {
+        for (int i = 0; i < set->count; i++)
+        {
+            subscriber_release(set->subscriber[i]);
+        }
+        rt_free(set);
+    }
+}
+
+/**
+ * Update the copy-on-write subscriber set of the message name(sub_lock must be held),
+ * the new set is built from the old one with the subscriber removed, and inserted again at its sorted position when added,
+ * the set is sorted by the subscriber priority so the most urgent subscriber is woken up first.
+ *
+ * @param msg_name: message name
+ * @param subscriber: subscriber handle
+ * @param add: RT_TRUE to add(or move after a priority change) the subscriber, RT_FALSE to remove it
+ * @return error code
+ */
+static rt_err_t subscriber_set_update(enum task_msg_name msg_name, task_msg_subscriber_t subscriber, rt_bool_t add)
+{
+    //writers are serialized by sub_lock, so the old set can be read without taking it
+    task_msg_subscriber_set_t old_set = subscriber_set_array[msg_name];
+    task_msg_subscriber_set_t set = RT_NULL;
+    int count = add ? 1 : 0;
+
+    if (old_set)
+    {
+        for (int i = 0; i < old_set->count; i++)
+        {
+            if (old_set->subscriber[i] != subscriber)
+                count++;
+        }
+        if (!add && count == old_set->count)
+            return RT_EOK;
+    }
+    else if (!add)
+    {
+        return RT_EOK;
+    }
+    if (count > 0)
+    {
+        set = rt_calloc(1, sizeof(struct task_msg_subscriber_set) + count * sizeof(task_msg_subscriber_t));
+        if (set == RT_NULL)
+        {
+            LOG_E("there is no memory available!");
+            return -RT_ENOMEM;
+        }
+        set->ref_count = 1;
+        rt_bool_t inserted = !add;
+        for (int i = 0; old_set && i < old_set->count; i++)
+        {
+            task_msg_subscriber_t entry = old_set->subscriber[i];
+            if (entry == subscriber)
+                continue;
+            //sorted by priority, the earlier added first among the same priority
+            if (!inserted && entry->priority > subscriber->priority)
+            {
+                set->subscriber[set->count++] = subscriber;
+                inserted = RT_TRUE;
+            }
+            set->subscriber[set->count++] = entry;
+        }
+        if (!inserted)
+        {
+            set->subscriber[set->count++] = subscriber;
+        }
+        //the old set keeps its own references until its last delivery releases it
+        rt_base_t level = rt_hw_interrupt_disable();
+        for (int i = 0; i < set->count; i++)
+        {
+            set->subscriber[i]->ref_count++;
+        }
+        rt_hw_interrupt_enable(level);
+    }
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    subscriber_set_array[msg_name] = set;
+    rt_hw_interrupt_enable(level);
+    subscriber_set_release(old_set);
+
+    return RT_EOK;
+}
+
+/**
+ * Add a message name to the subscriber(sub_lock must be held).
+ *
+ * @param subscriber: subscriber handle
+ * @param msg_name: message name
+ * @return error code
+ */
+static rt_err_t subscriber_topic_add(task_msg_subscriber_t subscriber, enum task_msg_name msg_name)
+{
+    if (subscriber_topic_test(subscriber, msg_name))
+        return RT_EOK;
+
+    int count = subscriber_topic_rank(subscriber, TASK_MSG_COUNT);
+    int rank = subscriber_topic_rank(subscriber, msg_name);
+    struct task_msg_subscriber_seq *seq = rt_malloc((count + 1) * sizeof(struct task_msg_subscriber_seq));
+    if (seq == RT_NULL)
+        return -RT_ENOMEM;
+
+    //the waiting thread reads the seq with interrupts disabled
+    rt_base_t level = rt_hw_interrupt_disable();
+    struct task_msg_subscriber_seq *old_seq = subscriber->seq;
+    for (int i = 0, j = 0; i <= count; i++)
+    {
+        if (i == rank)
+        {
+            seq[i].last_seq = seq_array[msg_name];
+            seq[i].gap = 0;
+        }
+        else
+        {
+            seq[i] = old_seq[j++];
+        }
+    }
+    subscriber->seq = seq;
+    subscriber->topic[msg_name / 32] |= 1UL << (msg_name % 32);
+    rt_hw_interrupt_enable(level);
+    if (old_seq != subscriber->seq_init)
+    {
+        rt_free(old_seq);
+    }
+
+    if (subscriber_set_update(msg_name, subscriber, RT_TRUE) != RT_EOK)
+    {
+        level = rt_hw_interrupt_disable();
+        subscriber->topic[msg_name / 32] &= ~(1UL << (msg_name % 32));
+        for (int i = rank; i < count; i++)
+        {
+            seq[i] = seq[i + 1];
+        }
+        rt_hw_interrupt_enable(level);
+        return -RT_ENOMEM;
+    }
+    return RT_EOK;
+}
+
+/**
+ * Remove a message name from the subscriber(sub_lock must be held),
+ * the subscriber is freed after the last delivery which still uses it.
+ *
+ * @param subscriber: subscriber handle
+ * @param msg_name: message name
+ */
+static void subscriber_topic_remove(task_msg_subscriber_t subscriber, enum task_msg_name msg_name)
+{
+    if (!subscriber_topic_test(subscriber, msg_name))
+        return;
+
+    int count = subscriber_topic_rank(subscriber, TASK_MSG_COUNT);
+    rt_base_t level = rt_hw_interrupt_disable();
+    subscriber->topic[msg_name / 32] &= ~(1UL << (msg_name % 32));
+    for (int i = subscriber_topic_rank(subscriber, msg_name); i < count - 1; i++)
+    {
+        subscriber->seq[i] = subscriber->seq[i + 1];
+    }
+    rt_hw_interrupt_enable(level);
+    subscriber_set_update(msg_name, subscriber, RT_FALSE);
+}
+
+/**
+ * Find the subscriber of the subscriber id and take a reference of it.
+ *
+ * @param subscriber_id: subscriber id
+ * @return the subscriber handle to be released by subscriber_release, RT_NULL if not found
+ */
+static task_msg_subscriber_t subscriber_find(int subscriber_id)
+{
+    rt_bool_t found = RT_FALSE;
+    task_msg_subscriber_t subscriber;
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    rt_slist_for_each_entry(subscriber, &msg_subscriber_slist, slist)
+    {
+        if (subscriber->subscriber_id == subscriber_id)
+        {
+            rt_base_t level = rt_hw_interrupt_disable();
+            subscriber->ref_count++;
+            rt_hw_interrupt_enable(level);
+            found = RT_TRUE;
+            break;
+        }
+    }
+    rt_mutex_release(&sub_lock);
+
+    return found ? subscriber : RT_NULL;
+}
+
+/**
+ * Create a subscriber.
+ * @param msg_name: message name
+ * @return create failed return -1,otherwise return >=0
+ */
+int task_msg_subscriber_create(enum task_msg_name msg_name)
+{
+    return task_msg_subscriber_create2(&msg_name, 1);
+}
+
+/**
+ * Create a subscriber and allow multiple topics to be subscribed.
+ * @param msg_name_list: message name array
+ * @param msg_name_list_len: message name array length
+ * @return create failed return -1,otherwise return >=0
+ */
+int task_msg_subscriber_create2(const enum task_msg_name *msg_name_list, rt_uint8_t msg_name_list_len)
+{
+    if (msg_name_list_len == 0)
+        return -1;
+    task_msg_subscriber_t subscriber = task_msg_subscriber_open(msg_name_list, msg_name_list_len);
+    return subscriber ? subscriber->subscriber_id : -1;
+}
+
+/**
+ * Open a subscriber handle which allows multiple topics to be subscribed,
+ * waiting by the handle takes neither a global lock nor a lookup.
+ * A handle without any topic can subscribe them later by task_msg_subscriber_add.
+ *
+ * @param msg_name_list: message name array
+ * @param msg_name_list_len: message name array length
+ * @return the subscriber handle, RT_NULL if failed
+ */
+task_msg_subscriber_t task_msg_subscriber_open(const enum task_msg_name *msg_name_list, rt_uint8_t msg_name_list_len)
+{
+    if (task_msg_bus_init_tag == RT_FALSE)
+        return RT_NULL;
+
+    for (int i = 0; i < msg_name_list_len; i++)
+    {
+        if (msg_name_list[i] >= TASK_MSG_COUNT)
+            return RT_NULL;
+    }
+
+    //one block holds the subscriber and the seq of the message names it starts with
+    task_msg_subscriber_t subscriber = rt_calloc(1,
+            sizeof(struct task_msg_subscriber) + msg_name_list_len * sizeof(struct task_msg_subscriber_seq));
+    if (subscriber == RT_NULL)
+        return RT_NULL;
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    subscriber->subscriber_id = subscriber_id++;
+    rt_hw_interrupt_enable(level);
+    subscriber->ref_count = 1;
+    subscriber->priority = task_msg_self_priority();
+    subscriber->seq = subscriber->seq_init;
+    rt_completion_init(&(subscriber->done));
+    rt_list_init(&(subscriber->pending));
+    for (int i = 0; i < msg_name_list_len; i++)
+    {
+        subscriber->topic[msg_name_list[i] / 32] |= 1UL << (msg_name_list[i] % 32);
+    }
+
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    for (int i = 0, rank = 0; i < TASK_MSG_COUNT; i++)
+    {
+        if (subscriber_topic_test(subscriber, (enum task_msg_name) i))
+            subscriber->seq[rank++].last_seq = seq_array[i];
+    }
+    rt_slist_append(&msg_subscriber_slist, &(subscriber->slist));
+    for (int i = 0; i < TASK_MSG_COUNT; i++)
+    {
+        if (subscriber_topic_test(subscriber, (enum task_msg_name) i)
+                && subscriber_set_update((enum task_msg_name) i, subscriber, RT_TRUE) != RT_EOK)
+        {
+            goto ERROR;
+        }
+    }
+    rt_mutex_release(&sub_lock);
+
+    return subscriber;
+
+    ERROR: rt_mutex_release(&sub_lock);
+    task_msg_subscriber_close(subscriber);
+    return RT_NULL;
+}
+
+/**
+ * Get the subscriber id of a subscriber handle.
+ * @param subscriber: subscriber handle
+ * @return subscriber id
+ */
+int task_msg_subscriber_id(task_msg_subscriber_t subscriber)
+{
+    return subscriber->subscriber_id;
+}
+
+/**
+ * Subscribe one more topic by a subscriber handle.
+ *
+ * @param subscriber: subscriber handle
+ * @param msg_name: message name
+ * @return error code
+ */
+rt_err_t task_msg_subscriber_add(task_msg_subscriber_t subscriber, enum task_msg_name msg_name)
+{
+    if (subscriber == RT_NULL || msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    rt_err_t rst = subscriber_topic_add(subscriber, msg_name);
+    rt_mutex_release(&sub_lock);
+
+    return rst;
+}
+
+/**
+ * Stop subscribing a topic by a subscriber handle, the messages of it already pending are still received.
+ *
+ * @param subscriber: subscriber handle
+ * @param msg_name: message name
+ * @return error code
+ */
+rt_err_t task_msg_subscriber_remove(task_msg_subscriber_t subscriber, enum task_msg_name msg_name)
+{
+    if (subscriber == RT_NULL || msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    subscriber_topic_remove(subscriber, msg_name);
+    rt_mutex_release(&sub_lock);
+
+    return RT_EOK;
+}
+
+/**
+ * Make the thread waiting by a subscriber handle return -RT_EINTR(can be used in ISR),
+ * if no thread is waiting, the next wait returns it at once.
+ *
+ * @param subscriber: subscriber handle
+ * @return error code
+ */
+rt_err_t task_msg_subscriber_interrupt(task_msg_subscriber_t subscriber)
+{
+    if (subscriber == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    subscriber->interrupted = RT_TRUE;
+    rt_hw_interrupt_enable(level);
+    rt_completion_done(&(subscriber->done));
+
+    return RT_EOK;
+}
+
+/**
+ * Close a subscriber handle, the unconsumed messages are released.
+ * @param subscriber: subscriber handle
+ */
+void task_msg_subscriber_close(task_msg_subscriber_t subscriber)
+{
+    if (subscriber == RT_NULL)
+        return;
+
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    for (int i = 0; i < TASK_MSG_COUNT; i++)
+    {
+        subscriber_topic_remove(subscriber, (enum task_msg_name) i);
+    }
+    rt_slist_remove(&msg_subscriber_slist, &(subscriber->slist));
+    rt_mutex_release(&sub_lock);
+
+    //no more messages are queued once it is marked deleted
+    rt_base_t level = rt_hw_interrupt_disable();
+    subscriber->deleted = RT_TRUE;
+    rt_hw_interrupt_enable(level);
+    while (1)
+    {
+        level = rt_hw_interrupt_disable();
+        if (rt_list_isempty(&(subscriber->pending)))
+        {
+            rt_hw_interrupt_enable(level);
+            break;
+        }
+        task_msg_wait_node_t wait_node = rt_list_first_entry(&(subscriber->pending), struct task_msg_wait_node, list);
+        rt_list_remove(&(wait_node->list));
+        subscriber->pending_count--;
+        subscriber->pending_bytes -= wait_node->args->msg_size;
+        rt_hw_interrupt_enable(level);
+
+        task_msg_mem_uncharge(wait_node->args->msg_name, sizeof(struct task_msg_wait_node));
+        task_msg_release(wait_node->args);
+        rt_free(wait_node);
+    }
+
+    //wake up the waiting thread, its reference defers the free until it has left task_msg_subscriber_wait
+    rt_completion_done(&(subscriber->done));
+    subscriber_release(subscriber);
+}
+
+/**
+ * Delete a subscriber.
+ * @param subscriber_id: subscriber id
+ */
+void task_msg_subscriber_delete(int subscriber_id)
+{
+    task_msg_subscriber_t subscriber = subscriber_find(subscriber_id);
+    if (subscriber)
+    {
+        task_msg_subscriber_close(subscriber);
+        subscriber_release(subscriber);
+    }
+}
+
+/**
+ * Set the priority of a subscriber, a message is handed to its subscribers from the smallest priority
+ * to the largest one, by default it is the priority of the thread which created the subscriber.
+ *
+ * @param subscriber_id: subscriber id
+ * @param priority: priority
+ * @return error code
+ */
+rt_err_t task_msg_subscriber_priority_set(int subscriber_id, rt_uint8_t priority)
+{
+    task_msg_subscriber_t subscriber = subscriber_find(subscriber_id);
+    if (subscriber == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_err_t rst = RT_EOK;
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    subscriber->priority = priority;
+    for (int i = 0; i < TASK_MSG_COUNT; i++)
+    {
+        if (subscriber_topic_test(subscriber, (enum task_msg_name) i)
+                && subscriber_set_update((enum task_msg_name) i, subscriber, RT_TRUE) != RT_EOK)
+        {
+            rst = -RT_ENOMEM;
+        }
+    }
+    rt_mutex_release(&sub_lock);
+    subscriber_release(subscriber);
+
+    return rst;
+}
+
+/**
+ * Set the wakeup policy of a subscriber, a throughput oriented subscriber wakes up once batch messages are pending
+ * or max_latency_ms after the first of them, whichever comes first, and drains them in one go.
+ *
+ * @param subscriber_id: subscriber id
+ * @param batch: the pending messages to wake up for(0 or 1:every message)
+ * @param max_latency_ms: the longest time a pending message waits for the wakeup(>0 when batch>1)
+ * @return error code
+ */
+rt_err_t task_msg_subscriber_wakeup_set(int subscriber_id, rt_uint32_t batch, rt_int32_t max_latency_ms)
+{
+    if (batch > 1 && max_latency_ms <= 0)
+        return -RT_EINVAL;
+
+    task_msg_subscriber_t subscriber = subscriber_find(subscriber_id);
+    if (subscriber == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_err_t rst = RT_EOK;
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    if (batch > 1)
+    {
+        rt_tick_t latency = rt_tick_from_millisecond(max_latency_ms);
+        if (subscriber->wake_timer == RT_NULL)
+        {
+            char name[RT_NAME_MAX];
+            rt_snprintf(name, RT_NAME_MAX, "subw%d", subscriber->subscriber_id);
+            subscriber->wake_timer = rt_timer_create(name, subscriber_wakeup_timeout, subscriber, latency,
+                    RT_TIMER_FLAG_ONE_SHOT | RT_TIMER_FLAG_SOFT_TIMER);
+            if (subscriber->wake_timer == RT_NULL)
+                rst = -RT_ENOMEM;
+        }
+        else
+        {
+            rt_timer_control(subscriber->wake_timer, RT_TIMER_CTRL_SET_TIME, &latency);
+        }
+    }
+    if (rst == RT_EOK)
+    {
+        rt_base_t level = rt_hw_interrupt_disable();
+        subscriber->wake_batch = batch;
+        //the messages already pending are handled by the new policy
+        enum task_msg_wakeup_result wakeup = subscriber_wakeup_check(subscriber, RT_FALSE);
+        rt_hw_interrupt_enable(level);
+        subscriber_wakeup(subscriber, wakeup);
+    }
+    rt_mutex_release(&sub_lock);
+    subscriber_release(subscriber);
+
+    return rst;
+}
+
+/**
+ * Blocks the current thread until a message of the subscriber handle is received,
+ * on SMP it spins TASK_MSG_WAIT_SPIN times for a message before sleeping.
+ * Only one thread may wait on a subscriber at a time.
+ *
+ * @param subscriber: subscriber handle
+ * @param timeout_ms: the waiting millisecond (-1:waiting forever until get resource)
+ * @param out_args: output parameter, return the received message reference address
+ * @return error code, -RT_EBUSY if another thread is waiting on the subscriber
+ */
+rt_err_t task_msg_subscriber_wait(task_msg_subscriber_t subscriber, rt_int32_t timeout_ms, task_msg_args_t *out_args)
+{
+    if (subscriber == RT_NULL)
+        return -RT_EINVAL;
+
+    //the completion wakes up a single thread, and the reference keeps the subscriber valid when it is closed meanwhile
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (subscriber->waiting)
+    {
+        rt_hw_interrupt_enable(level);
+        return -RT_EBUSY;
+    }
+    subscriber->waiting = RT_TRUE;
+    subscriber->ref_count++;
+    rt_hw_interrupt_enable(level);
+
+#if defined(RT_USING_SMP) && TASK_MSG_WAIT_SPIN > 0
+    rt_list_t *volatile *pending_next = &(subscriber->pending.next);
+    for (int i = 0; i < TASK_MSG_WAIT_SPIN && *pending_next == &(subscriber->pending); i++)
+    {
+    }
+#endif
+
+    rt_err_t rst;
+    rt_int32_t timeout = rt_tick_from_millisecond(timeout_ms), wait = timeout;
+    rt_tick_t start = rt_tick_get();
+    while (1)
+    {
+        rt_bool_t expired;
+        task_msg_args_t args;
+        task_msg_wait_node_t wait_node;
+        if (timeout >= 0)
+        {
+            rt_tick_t elapsed = rt_tick_get() - start;
+            wait = elapsed >= (rt_tick_t) timeout ? 0 : timeout - elapsed;
+        }
+
+        level = rt_hw_interrupt_disable();
+        if (subscriber->deleted)
+        {
+            rt_hw_interrupt_enable(level);
+            rst = -RT_EINVAL;
+            break;
+        }
+        if (subscriber->interrupted)
+        {
+            subscriber->interrupted = RT_FALSE;
+            rt_hw_interrupt_enable(level);
+            rst = -RT_EINTR;
+            break;
+        }
+        if (rt_list_isempty(&(subscriber->pending)))
+        {
+            rt_hw_interrupt_enable(level);
+            //the wakeups may be coalesced, so drain the pending messages before sleeping
+            if ((rst = rt_completion_wait(&(subscriber->done), wait)) != RT_EOK)
+                break;
+            continue;
+        }
+        wait_node = rt_list_first_entry(&(subscriber->pending), struct task_msg_wait_node, list);
+        rt_list_remove(&(wait_node->list));
+        args = wait_node->args;
+        subscriber->pending_count--;
+        subscriber->pending_bytes -= args->msg_size;
+        expired = task_msg_args_expired(args);
+        //the message name may have been removed after the message was queued
+        if (!expired && subscriber_topic_test(subscriber, args->msg_name))
+        {
+            //the messages missed since the last one received by this subscriber
+            struct task_msg_subscriber_seq *seq = &(subscriber->seq[subscriber_topic_rank(subscriber, args->msg_name)]);
+            rt_int32_t diff = (rt_int32_t) (args->seq - seq->last_seq);
+            seq->gap = diff > 0 ? diff - 1 : 0;
+            if (diff > 0)
+                seq->last_seq = args->seq;
+        }
+        rt_hw_interrupt_enable(level);
+        rt_free(wait_node);
+        task_msg_mem_uncharge(args->msg_name, sizeof(struct task_msg_wait_node));
+
+        if (!expired)
+        {
+            *out_args = args;
+            TASK_MSG_TRACE(WAIT_WAKEUP, args->msg_name, subscriber->subscriber_id, 0);
+            rst = RT_EOK;
+            break;
+        }
+
+        //too old to act on, go on waiting for the rest of the timeout
+        task_msg_args_expire(args, subscriber->subscriber_id);
+    }
+
+    level = rt_hw_interrupt_disable();
+    subscriber->waiting = RT_FALSE;
+    rt_hw_interrupt_enable(level);
+    subscriber_release(subscriber);
+
+    return rst;
+}
+
+/**
+ * Blocks the current thread until a message of the specified message name is received.
+ *
+ * @param subscriber_id: subscriber id
+ * @param timeout_ms: the waiting millisecond (-1:waiting forever until get resource)
+ * @param out_args: output parameter, return the received message reference address
+ * @return error code
+ */
+rt_err_t task_msg_wait_until(int subscriber_id, rt_int32_t timeout_ms, struct task_msg_args **out_args)
+{
+    if (task_msg_bus_init_tag == RT_FALSE)
+        return -RT_EINVAL;
+
+    task_msg_subscriber_t subscriber = subscriber_find(subscriber_id);
+    if (subscriber == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_err_t rst = task_msg_subscriber_wait(subscriber, timeout_ms, out_args);
+    subscriber_release(subscriber);
+
+    return rst;
+}
+
+/**
+ * Get the number of messages the subscriber missed right before the last message
+ * it received by task_msg_wait_until, so it can catch up from the sequence number.
+ *
+ * @param subscriber_id: subscriber id
+ * @param msg_name: message name
+ * @param gap: output parameter, the missed message count
+ * @return error code
+ */
+rt_err_t task_msg_subscriber_gap(int subscriber_id, enum task_msg_name msg_name, rt_uint32_t *gap)
+{
+    if (task_msg_bus_init_tag == RT_FALSE)
+        return -RT_EINVAL;
+
+    task_msg_subscriber_t subscriber = subscriber_find(subscriber_id);
+    if (subscriber == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_err_t rst = -RT_EINVAL;
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (msg_name < TASK_MSG_COUNT && subscriber_topic_test(subscriber, msg_name))
+    {
+        *gap = subscriber->seq[subscriber_topic_rank(subscriber, msg_name)].gap;
+        rst = RT_EOK;
+    }
+    rt_hw_interrupt_enable(level);
+    subscriber_release(subscriber);
+
+    return rst;
+}
+
+/**
+ * Bind a subscriber to the event set, when a message arrives the subscriber will also
+ * send the event bits, so one thread can wait for several subscribers and other IPC sources.
+ *
+ * @param subscriber_id: subscriber id
+ * @param event: event object(RT_NULL:unbind)
+ * @param set: event bits of this subscriber
+ * @return error code
+ */
+rt_err_t task_msg_subscriber_bind_event(int subscriber_id, rt_event_t event, rt_uint32_t set)
+{
+    if (task_msg_bus_init_tag == RT_FALSE)
+        return -RT_EINVAL;
+
+    task_msg_subscriber_t subscriber = subscriber_find(subscriber_id);
+    if (subscriber == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    subscriber->event = event;
+    subscriber->event_set = event ? set : 0;
+    rt_hw_interrupt_enable(level);
+    subscriber_release(subscriber);
+
+    return RT_EOK;
+}
+
+/**
+ * Blocks the current thread until any bit of the event set is ready,
+ * the bits of subscribers which still have unconsumed messages to wake up for are ready immediately.
+ *
+ * @param event: event object which the subscribers are bound to
+ * @param set: the event bits to wait for(subscriber bits and other sources bits)
+ * @param timeout_ms: the waiting millisecond (-1:waiting forever until get resource)
+ * @param recved: output parameter, return the ready event bits
+ * @return error code
+ */
+rt_err_t task_msg_poll(rt_event_t event, rt_uint32_t set, rt_int32_t timeout_ms, rt_uint32_t *recved)
+{
+    if (task_msg_bus_init_tag == RT_FALSE || event == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_uint32_t pending = 0;
+    task_msg_subscriber_t subscriber;
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    rt_slist_for_each_entry(subscriber, &msg_subscriber_slist, slist)
+    {
+        if (subscriber->event == event && (subscriber->event_set & set))
+        {
+            //the messages left below a coalesced wakeup batch are bounded by the wakeup timer
+            rt_base_t level = rt_hw_interrupt_disable();
+            enum task_msg_wakeup_result wakeup = subscriber_wakeup_check(subscriber, RT_FALSE);
+            rt_hw_interrupt_enable(level);
+            if (wakeup == TASK_MSG_WAKEUP_NOW)
+                pending |= subscriber->event_set;
+            else
+                subscriber_wakeup(subscriber, wakeup);
+        }
+    }
+    rt_mutex_release(&sub_lock);
+    if (pending)
+    {
+        rt_event_send(event, pending);
+    }
+
+    return rt_event_recv(event, set, RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR, rt_tick_from_millisecond(timeout_ms),
+            recved);
+}
+
+/**
+ * Subscribe the message with the specified name and set the callback function,
+ * the priority of the current thread is the priority of the callback.
+ *
+ * @param msg_name: message name
+ * @param callback: callback function name
+ * @return error code
+ */
+rt_err_t task_msg_subscribe(enum task_msg_name msg_name, void (*callback)(task_msg_args_t msg_args))
+{
+    return task_msg_subscribe_priority(msg_name, callback, task_msg_self_priority());
+}
+
+/**
+ * Subscribe the message with the specified name and set the callback function with a priority,
+ * the callbacks of a message are called from the smallest priority to the largest one.
+ *
+ * @param msg_name: message name
+ * @param callback: callback function name
+ * @param priority: priority
+ * @return error code
+ */
+rt_err_t task_msg_subscribe_priority(enum task_msg_name msg_name, void (*callback)(task_msg_args_t msg_args),
+        rt_uint8_t priority)
+{
+    if (task_msg_bus_init_tag == RT_FALSE || msg_name >= TASK_MSG_COUNT || callback == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_mutex_take(&cb_lock, RT_WAITING_FOREVER);
+    task_msg_callback_set_t old_set = callback_set_array[msg_name];
+    int count = old_set ? old_set->count : 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (old_set->item[i].callback == callback)
+        {
+            rt_mutex_release(&cb_lock);
+            LOG_W("this task msg callback with msg_name[%d] is exist!", msg_name);
+            return RT_EOK;
+        }
+    }
+
+    task_msg_callback_set_t set = rt_calloc(1,
+            sizeof(struct task_msg_callback_set) + (count + 1) * sizeof(struct task_msg_callback_item));
+    if (set == RT_NULL)
+    {
+        rt_mutex_release(&cb_lock);
+        LOG_E("there is no memory available!");
+        return -RT_ENOMEM;
+    }
+    set->ref_count = 1;
+    set->count = count + 1;
+    //insert it after the callbacks of the same priority
+    int pos = 0;
+    while (pos < count && old_set->item[pos].priority <= priority)
+    {
+        pos++;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        set->item[i < pos ? i : i + 1] = old_set->item[i];
+    }
+    set->item[pos].callback = callback;
+    set->item[pos].priority = priority;
+    callback_set_swap(msg_name, set);
+    rt_mutex_release(&cb_lock);
+
+    return RT_EOK;
+}
+
+/**
+ * Unsubscribe the message with the specified name and cancle the callback function,
+ * a delivery which is already in progress may still call it once.
+ *
+ * @param msg_name: message name
+ * @param callback: callback function name
+ * @return error code
+ */
+rt_err_t task_msg_unsubscribe(enum task_msg_name msg_name, void (*callback)(task_msg_args_t msg_args))
+{
+    if (task_msg_bus_init_tag == RT_FALSE || msg_name >= TASK_MSG_COUNT || callback == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_err_t rst = RT_EOK;
+    rt_mutex_take(&cb_lock, RT_WAITING_FOREVER);
+    task_msg_callback_set_t old_set = callback_set_array[msg_name];
+    int count = old_set ? old_set->count : 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (old_set->item[i].callback == callback)
+        {
+            task_msg_callback_set_t set = RT_NULL;
+            if (count > 1)
+            {
+                set = rt_calloc(1,
+                        sizeof(struct task_msg_callback_set) + (count - 1) * sizeof(struct task_msg_callback_item));
+                if (set == RT_NULL)
+                {
+                    LOG_E("there is no memory available!");
+                    rst = -RT_ENOMEM;
+                    break;
+                }
+                set->ref_count = 1;
+                for (int j = 0; j < count; j++)
+                {
+                    if (j != i)
+                    {
+                        set->item[set->count++] = old_set->item[j];
+                    }
+                }
+            }
+            callback_set_swap(msg_name, set);
+            break;
+        }
+    }
+    rt_mutex_release(&cb_lock);
+
+    return rst;
+}
+
+/**
+ * Stamp, trace and record a published message, the time to live of the message name counts from here.
+ *
+ * @param args: message reference
+ * @param direct: published by task_msg_publish_obj_direct
+ */
+static void task_msg_publish_hook(task_msg_args_t args, rt_bool_t direct)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    args->seq = ++seq_array[args->msg_name];
+    rt_hw_interrupt_enable(level);
+    args->stamp = rt_tick_get();
+    //a deadline set by task_msg_args_deadline_set is kept
+    if (args->deadline == 0 && ttl_array[args->msg_name] > 0)
+    {
+        args->deadline = args->stamp + ttl_array[args->msg_name];
+        if (args->deadline == 0)
+            args->deadline = 1;
+    }
+
+    TASK_MSG_TRACE(PUBLISH, args->msg_name, -1, direct);
+#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
+    //objects with dup hooks hold pointers which can not be replayed
+    if (dup_release_hooks[args->msg_name].dup == RT_NULL)
+#endif
+    TASK_MSG_RECORD(args->msg_name, args->msg_obj, args->msg_size);
+}
+
+/**
+ * Create a message args and copy the message object into it.
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @return the message args, RT_NULL if there is no memory available
+ */
+static task_msg_args_t task_msg_args_create(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+{
+    //fail fast before anything is allocated
+    rt_size_t bytes = task_msg_args_bytes(msg_name, msg_obj, msg_size);
+    if (!task_msg_mem_charge(msg_name, bytes, RT_TRUE))
+        return RT_NULL;
+
+    task_msg_args_t msg_args = rt_calloc(1, sizeof(struct task_msg_args));
+    if (msg_args == RT_NULL)
+    {
+        task_msg_mem_uncharge(msg_name, bytes);
+        return RT_NULL;
+    }
+
+    msg_args->msg_name = msg_name;
+    msg_args->msg_size = msg_size;
+    msg_args->msg_obj = RT_NULL;
+    msg_args->ref_count = 1;
+    if (msg_obj && msg_size > 0)
+    {
+#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
+        if (dup_release_hooks[msg_name].dup)
+        {
+            RT_ASSERT(dup_release_hooks[msg_name].msg_name == msg_name);
+            msg_args->msg_obj = dup_release_hooks[msg_name].dup(msg_obj);
+        }
+        else
+        {
+            msg_args->msg_obj = rt_calloc(1, msg_size);
+            if (msg_args->msg_obj)
+            {
+                rt_memcpy(msg_args->msg_obj, msg_obj, msg_size);
+            }
+        }
+#else
+        msg_args->msg_obj = rt_calloc(1, msg_size);
+        if (msg_args->msg_obj)
+        {
+            rt_memcpy(msg_args->msg_obj, msg_obj, msg_size);
+        }
+#endif
+        if (msg_args->msg_obj == RT_NULL)
+        {
+            rt_free(msg_args);
+            task_msg_mem_uncharge(msg_name, bytes);
+            return RT_NULL;
+        }
+    }
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    msg_in_flight++;
+    rt_hw_interrupt_enable(level);
+
+    return msg_args;
+}
+
+/**
+ * Take one more reference of a message, so a callback can hand the very same message
+ * to other threads and release it later by task_msg_release.
+ * A message lent by task_msg_publish_obj_direct is copied once here instead.
+ *
+ * @param args: message reference
+ * @return the message reference to be released, RT_NULL if there is no memory available
+ */
+task_msg_args_t task_msg_retain(task_msg_args_t args)
+{
+    if (args == RT_NULL)
+        return RT_NULL;
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (args->ref_count > 0)
+    {
+        args->ref_count++;
+        rt_hw_interrupt_enable(level);
+        return args;
+    }
+    rt_hw_interrupt_enable(level);
+
+    //the publisher's object is only valid during the callbacks
+    task_msg_args_t copy = task_msg_args_create(args->msg_name, args->msg_obj, args->msg_size);
+    if (copy)
+    {
+        copy->seq = args->seq;
+        copy->stamp = args->stamp;
+        copy->deadline = args->deadline;
+        copy->origin = args->origin;
+    }
+    return copy;
+}
+
+/**
+ * Deliver a message to the subscribers and the callbacks of the message name.
+ *
+ * @param args: message reference
+ */
+static void task_msg_dispatch(task_msg_args_t args)
+{
+    task_msg_callback_set_t callback_set;
+    task_msg_subscriber_set_t subscriber_set;
+    task_msg_wait_node_t msg_wait_node;
+
+    TASK_MSG_TRACE(DISPATCH_START, args->msg_name, -1, 0);
+
+    subscriber_set = subscriber_set_take(args->msg_name);
+    for (int i = 0; subscriber_set && i < subscriber_set->count; i++)
+    {
+        task_msg_subscriber_t subscriber = subscriber_set->subscriber[i];
+        msg_wait_node = rt_calloc(1, sizeof(struct task_msg_wait_node));
+        if (msg_wait_node == RT_NULL)
+        {
+            LOG_W("no memory to create msg_wait_node!");
+            TASK_MSG_TRACE(DROP, args->msg_name, subscriber->subscriber_id, 0);
+            break;
+        }
+
+        msg_wait_node->args = args;
+        rt_base_t level = rt_hw_interrupt_disable();
+        //the subscriber may be closed after the set was taken
+        if (subscriber->deleted)
+        {
+            rt_hw_interrupt_enable(level);
+            rt_free(msg_wait_node);
+            continue;
+        }
+        args->ref_count++;
+        rt_list_insert_before(&(subscriber->pending), &(msg_wait_node->list));
+        subscriber->pending_count++;
+        subscriber->pending_bytes += args->msg_size;
+        enum task_msg_wakeup_result wakeup = subscriber_wakeup_check(subscriber, RT_TRUE);
+        rt_hw_interrupt_enable(level);
+        task_msg_mem_charge(args->msg_name, sizeof(struct task_msg_wait_node), RT_FALSE);
+        //the set holds the subscriber, so it is still valid
+        subscriber_wakeup(subscriber, wakeup);
+    }
+    subscriber_set_release(subscriber_set);
+
+    //msg callback
+    callback_set = callback_set_take(args->msg_name);
+    for (int i = 0; callback_set && i < callback_set->count; i++)
+    {
+        TASK_MSG_TRACE(CALLBACK_ENTER, args->msg_name, -1, i);
+        callback_set->item[i].callback(args);
+        TASK_MSG_TRACE(CALLBACK_EXIT, args->msg_name, -1, i);
+    }
+    callback_set_release(callback_set);
+    TASK_MSG_TRACE(DISPATCH_END, args->msg_name, -1, subscriber_set ? subscriber_set->count : 0);
+
+    //release the reference taken by the publisher
+    task_msg_release(args);
+}
+
+/**
+ * Keep the last message of the debounced message name in its debounce schedule,
+ * which is published once no other message arrives during the quiet period.
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @param origin: TASK_MSG_ORIGIN_XXX of the message
+ * @return error code
+ */
+static rt_err_t task_msg_debounce(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size, rt_uint8_t origin)
+{
+    rt_err_t rst = RT_EOK;
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    if (debounce_array[msg_name])
+    {
+        rst = task_msg_schedule_update(debounce_array[msg_name], msg_obj, msg_size);
+    }
+    else
+    {
+        debounce_array[msg_name] = task_msg_schedule_create(msg_name, msg_obj, msg_size);
+        if (debounce_array[msg_name] == RT_NULL)
+            rst = -RT_ENOMEM;
+    }
+    if (rst == RT_EOK)
+    {
+        debounce_array[msg_name]->args->origin = origin;
+        rt_base_t level = rt_hw_interrupt_disable();
+        if (policy_array[msg_name].debounce_pending)
+        {
+            stats_array[msg_name].debounced++;
+        }
+        policy_array[msg_name].debounce_pending = RT_TRUE;
+        rt_int32_t debounce_ms = policy_array[msg_name].debounce_ms;
+        rt_hw_interrupt_enable(level);
+
+        rst = task_msg_schedule_start(debounce_array[msg_name], debounce_ms, 1, 0);
+    }
+    rt_mutex_release(&msg_tlck);
+
+    return rst;
+}
+
+/**
+ * Deliver a message object in the current thread, the publish policy has been applied.
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @return error code
+ */
+static rt_err_t task_msg_deliver_direct(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    rt_bool_t has_subscriber = (subscriber_set_array[msg_name] != RT_NULL);
+    rt_hw_interrupt_enable(level);
+
+    if (!has_subscriber)
+    {
+        //callbacks only: lend the publisher's object, nothing is allocated
+        struct task_msg_args msg_args;
+        rt_memset(&msg_args, 0, sizeof(msg_args));
+        msg_args.msg_name = msg_name;
+        msg_args.msg_obj = msg_size > 0 ? msg_obj : RT_NULL;
+        msg_args.msg_size = msg_size;
+        task_msg_publish_hook(&msg_args, RT_TRUE);
+        task_msg_callback_set_t callback_set = callback_set_take(msg_name);
+        for (int i = 0; callback_set && i < callback_set->count; i++)
+        {
+            TASK_MSG_TRACE(CALLBACK_ENTER, msg_name, -1, i);
+            callback_set->item[i].callback(&msg_args);
+            TASK_MSG_TRACE(CALLBACK_EXIT, msg_name, -1, i);
+        }
+        callback_set_release(callback_set);
+        task_msg_args_decoded_free(&msg_args);
+        return RT_EOK;
+    }
+
+    task_msg_args_t msg_args = task_msg_args_create(msg_name, msg_obj, msg_size);
+    if (msg_args == RT_NULL)
+    {
+        LOG_E("task msg publish failed! msg_args create failed!");
+        TASK_MSG_TRACE(DROP, msg_name, -1, 0);
+        return -RT_ENOMEM;
+    }
+    task_msg_publish_hook(msg_args, RT_TRUE);
+    task_msg_dispatch(msg_args);
+
+    return RT_EOK;
+}
+
+/**
+ * Keep a message published before task_msg_bus_init in a static buffer(the heap may not be ready),
+ * task_msg_bus_init publishes the kept messages in order.
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @return error code, -RT_EFULL if the buffer is full
+ */
+static rt_err_t task_msg_early_append(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+{
+#if TASK_MSG_EARLY_BUFFER_SIZE > 0
+    if (msg_name >= TASK_MSG_COUNT || msg_size > 0xFFFF)
+        return -RT_EINVAL;
+#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
+    //the pointers in the object may be gone when it is dup'ed
+    if (dup_release_hooks[msg_name].dup)
+        return -RT_EINVAL;
+#endif
+    //a message without an object, nothing to copy
+    if (msg_obj == RT_NULL)
+    {
+        msg_size = 0;
+    }
+
+    rt_size_t size = RT_ALIGN(sizeof(struct task_msg_early_record) + msg_size, sizeof(rt_uint32_t));
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (task_msg_bus_init_tag)
+    {
+        //task_msg_bus_init has just finished
+        rt_hw_interrupt_enable(level);
+        return task_msg_publish_obj(msg_name, msg_obj, msg_size);
+    }
+    if (early_used + size > sizeof(early_buffer))
+    {
+        rt_hw_interrupt_enable(level);
+        return -RT_EFULL;
+    }
+    struct task_msg_early_record *record = (struct task_msg_early_record *) ((rt_uint8_t *) early_buffer + early_used);
+    record->msg_name = msg_name;
+    record->msg_size = msg_size;
+    if (msg_obj && msg_size > 0)
+    {
+        rt_memcpy(record + 1, msg_obj, msg_size);
+    }
+    early_used += size;
+    rt_hw_interrupt_enable(level);
+
+    return RT_EOK;
+#else
+    return -RT_EINVAL;
+#endif
+}
+
+/**
+ * Publish a message object in the current thread, the callbacks run before this function returns,
+ * and the message object is not copied when there is no subscriber waiting for it(shall not be used in ISR).
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @return error code
+ */
+rt_err_t task_msg_publish_obj_direct(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+{
+    if (task_msg_bus_init_tag == RT_FALSE)
+        return task_msg_early_append(msg_name, msg_obj, msg_size);
+
+    switch (task_msg_policy_apply(msg_name))
+    {
+    case TASK_MSG_POLICY_SUPPRESS:
+        return -RT_EBUSY;
+    case TASK_MSG_POLICY_DEBOUNCE:
+        return task_msg_debounce(msg_name, msg_obj, msg_size, TASK_MSG_ORIGIN_LOCAL);
+    default:
+        break;
+    }
+
+    return task_msg_deliver_direct(msg_name, msg_obj, msg_size);
+}
+
+/**
+ * Set the publish mode of the message name.
+ *
+ * @param msg_name: message name
+ * @param direct: RT_TRUE:the publisher's thread delivers the message(see task_msg_publish_obj_direct),
+ *                RT_FALSE:the message is queued and delivered by the msg_bus thread
+ * @return error code
+ */
+rt_err_t task_msg_direct_set(enum task_msg_name msg_name, rt_bool_t direct)
+{
+    if (msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
+    direct_publish_array[msg_name] = direct;
+
+    return RT_EOK;
+}
+
+/**
+ * Append a message to the slist:msg_slist and wake up the msg_bus thread.
+ *
+ * @param node: message node
+ * @param args: message reference
+ */
+static void task_msg_queue_append(task_msg_args_node_t node, task_msg_args_t args)
+{
+    node->args = args;
+    rt_slist_init(&(node->slist));
+    rt_mutex_take(&msg_lock, RT_WAITING_FOREVER);
+#ifdef TASK_MSG_USING_EDF
+    //earliest deadline first, the messages without deadline keep the publish order behind them
+    rt_slist_t *prev = &msg_slist;
+    while (args->deadline != 0 && prev->next)
+    {
+        task_msg_args_t item = rt_slist_entry(prev->next, struct task_msg_args_node, slist)->args;
+        if (item->deadline == 0 || (rt_int32_t) (args->deadline - item->deadline) < 0)
+            break;
+        prev = prev->next;
+    }
+    rt_slist_insert(prev, &(node->slist));
+#else
+    rt_slist_append(&msg_slist, &(node->slist));
+#endif
+    rt_mutex_release(&msg_lock);
+
+    rt_sem_release(&msg_sem);
+}
+
+/**
+ * Publish a message object, the publish policy has been applied or is bypassed(scheduled messages).
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @return error code
+ */
+static rt_err_t task_msg_publish_obj_internal(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+{
+    if (direct_publish_array[msg_name])
+        return task_msg_deliver_direct(msg_name, msg_obj, msg_size);
+
+    task_msg_args_node_t node = rt_calloc(1, sizeof(struct task_msg_args_node));
+    if (node == RT_NULL)
+    {
+        LOG_E("task msg publish failed! args_node create failed!");
+        TASK_MSG_TRACE(DROP, msg_name, -1, 0);
+        return -RT_ENOMEM;
+    }
+
+    task_msg_args_t msg_args = task_msg_args_create(msg_name, msg_obj, msg_size);
+    if (msg_args == RT_NULL)
+    {
+        rt_free(node);
+        LOG_E("task msg publish failed! msg_args create failed!");
+        TASK_MSG_TRACE(DROP, msg_name, -1, 0);
+        return -RT_ENOMEM;
+    }
+    task_msg_publish_hook(msg_args, RT_FALSE);
+    task_msg_queue_append(node, msg_args);
+
+    return RT_EOK;
+}
+
+/**
+ * Publish a message object through the rate limit, the minimum interval and the debounce of its message name.
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @return error code
+ */
+static rt_err_t task_msg_publish_obj_policy(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+{
+    switch (task_msg_policy_apply(msg_name))
+    {
+    case TASK_MSG_POLICY_SUPPRESS:
+        return -RT_EBUSY;
+    case TASK_MSG_POLICY_DEBOUNCE:
+        return task_msg_debounce(msg_name, msg_obj, msg_size, TASK_MSG_ORIGIN_LOCAL);
+    default:
+        break;
+    }
+
+    return task_msg_publish_obj_internal(msg_name, msg_obj, msg_size);
+}
+
+/**
+ * Publish a message object(shall not be used in ISR).
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @return error code
+ */
+rt_err_t task_msg_publish_obj(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+{
+    if (task_msg_bus_init_tag == RT_FALSE)
+        return task_msg_early_append(msg_name, msg_obj, msg_size);
+
+    return task_msg_publish_obj_policy(msg_name, msg_obj, msg_size);
+}
+
+/**
+ * Allocate a message whose object is filled in by the caller, so the payload can be written
+ * straight into the bus-owned storage, then publish it by task_msg_publish_args.
+ * Not available for the message names with dup hooks.
+ *
+ * @param msg_name: message name
+ * @param msg_size: message size
+ * @return the message args, RT_NULL if failed
+ */
+task_msg_args_t task_msg_args_alloc(enum task_msg_name msg_name, rt_size_t msg_size)
+{
+    if (task_msg_bus_init_tag == RT_FALSE || msg_name >= TASK_MSG_COUNT)
+        return RT_NULL;
+
+#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
+    if (dup_release_hooks[msg_name].dup)
+    {
+        LOG_W("msg_name[%d] has a dup hook, use task_msg_publish_obj!", msg_name);
+        return RT_NULL;
+    }
+#endif
+
+    task_msg_args_t msg_args = task_msg_args_create(msg_name, RT_NULL, 0);
+    if (msg_args == RT_NULL)
+        return RT_NULL;
+    if (msg_size > 0)
+    {
+        if (!task_msg_mem_charge(msg_name, msg_size, RT_TRUE))
+        {
+            task_msg_args_free(msg_args);
+            return RT_NULL;
+        }
+        msg_args->msg_obj = rt_malloc(msg_size);
+        if (msg_args->msg_obj == RT_NULL)
+        {
+            task_msg_mem_uncharge(msg_name, msg_size);
+            task_msg_args_free(msg_args);
+            return RT_NULL;
+        }
+        msg_args->msg_size = msg_size;
+    }
+
+    return msg_args;
+}
+
+/**
+ * Wrap an object owned by the caller(e.g. a memory pool block) in a message without copying it,
+ * then publish it by task_msg_publish_args. obj_free is called with the object in the thread
+ * which releases the last reference, the object is still the caller's if this function fails.
+ * Not available for the message names with dup hooks.
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ * @param obj_free: frees the object
+ * @return the message args, RT_NULL if failed
+ */
+task_msg_args_t task_msg_args_attach(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size,
+        void (*obj_free)(void *msg_obj))
+{
+    if (task_msg_bus_init_tag == RT_FALSE || msg_name >= TASK_MSG_COUNT || msg_obj == RT_NULL
+            || obj_free == RT_NULL)
+        return RT_NULL;
+
+#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
+    if (dup_release_hooks[msg_name].dup)
+    {
+        LOG_W("msg_name[%d] has a dup hook, use task_msg_publish_obj!", msg_name);
+        return RT_NULL;
+    }
+#endif
+
+    task_msg_args_t msg_args = task_msg_args_create(msg_name, RT_NULL, 0);
+    if (msg_args == RT_NULL)
+        return RT_NULL;
+    msg_args->msg_obj = msg_obj;
+    msg_args->msg_size = msg_size;
+    msg_args->obj_free = obj_free;
+
+    return msg_args;
+}
+
+/**
+ * Publish a message allocated by the bus, the publish policy has been applied.
+ *
+ * @param args: message reference
+ * @return error code
+ */
+static rt_err_t task_msg_publish_args_internal(task_msg_args_t args)
+{
+    if (direct_publish_array[args->msg_name])
+    {
+        task_msg_publish_hook(args, RT_TRUE);
+        task_msg_dispatch(args);
+        return RT_EOK;
+    }
+
+    task_msg_args_node_t node = rt_calloc(1, sizeof(struct task_msg_args_node));
+    if (node == RT_NULL)
+    {
+        LOG_E("task msg publish failed! args_node create failed!");
+        TASK_MSG_TRACE(DROP, args->msg_name, -1, 0);
+        task_msg_args_free(args);
+        return -RT_ENOMEM;
+    }
+    task_msg_publish_hook(args, RT_FALSE);
+    task_msg_queue_append(node, args);
+
+    return RT_EOK;
+}
+
+/**
+ * Publish a message allocated by task_msg_args_alloc or task_msg_args_attach, the bus takes the ownership
+ * of the args even if failed(shall not be used in ISR).
+ *
+ * @param args: message reference
+ * @return error code
+ */
+rt_err_t task_msg_publish_args(task_msg_args_t args)
+{
+    if (task_msg_bus_init_tag == RT_FALSE || args == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_err_t rst;
+    switch (task_msg_policy_apply(args->msg_name))
+    {
+    case TASK_MSG_POLICY_SUPPRESS:
+        task_msg_args_free(args);
+        return -RT_EBUSY;
+    case TASK_MSG_POLICY_DEBOUNCE:
+        rst = task_msg_debounce(args->msg_name, args->msg_obj, args->msg_size, args->origin);
+        task_msg_args_free(args);
+        return rst;
+    default:
+        break;
+    }
+
+    return task_msg_publish_args_internal(args);
+}
+
+/**
+ * Publish a message gathered from several buffers, the parts are copied straight
+ * into the bus-owned storage in one pass(shall not be used in ISR).
+ * Not available for the message names with dup hooks.
+ *
+ * @param msg_name: message name
+ * @param parts: buffers to be gathered in order
+ * @param count: buffer count
+ * @return error code
+ */
+rt_err_t task_msg_publish_iov(enum task_msg_name msg_name, const struct task_msg_iov *parts, rt_size_t count)
+{
+    if (task_msg_bus_init_tag == RT_FALSE || msg_name >= TASK_MSG_COUNT || (parts == RT_NULL && count > 0))
+        return -RT_EINVAL;
+#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
+    //rejected before a policy token is spent, the object can not be built in place
+    if (dup_release_hooks[msg_name].dup)
+        return -RT_EINVAL;
+#endif
+
+    rt_size_t i, msg_size = 0, offset = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (parts[i].iov_base == RT_NULL && parts[i].iov_len > 0)
+            return -RT_EINVAL;
+        msg_size += parts[i].iov_len;
+    }
+
+    enum task_msg_policy_result result = task_msg_policy_apply(msg_name);
+    if (result == TASK_MSG_POLICY_SUPPRESS)
+        return -RT_EBUSY;
+
+    task_msg_args_t args = task_msg_args_alloc(msg_name, msg_size);
+    if (args == RT_NULL)
+    {
+        LOG_E("task msg publish failed! msg_args create failed!");
+        TASK_MSG_TRACE(DROP, msg_name, -1, 0);
+        return -RT_ENOMEM;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (parts[i].iov_len > 0)
+        {
+            rt_memcpy((rt_uint8_t *) args->msg_obj + offset, parts[i].iov_base, parts[i].iov_len);
+            offset += parts[i].iov_len;
+        }
+    }
+
+    if (result == TASK_MSG_POLICY_DEBOUNCE)
+    {
+        rt_err_t rst = task_msg_debounce(msg_name, args->msg_obj, args->msg_size, TASK_MSG_ORIGIN_LOCAL);
+        task_msg_args_free(args);
+        return rst;
+    }
+    return task_msg_publish_args_internal(args);
+}
+
+/**
+ * Copy a received message object into several caller buffers in order.
+ *
+ * @param args: message reference
+ * @param parts: buffers to be filled in order
+ * @param count: buffer count
+ * @return the copied size
+ */
+rt_size_t task_msg_args_scatter(task_msg_args_t args, const struct task_msg_iov *parts, rt_size_t count)
+{
+    rt_size_t i, len, offset = 0;
+    if (args == RT_NULL || args->msg_obj == RT_NULL)
+        return 0;
+
+    for (i = 0; i < count && offset < args->msg_size; i++)
+    {
+        len = args->msg_size - offset;
+        if (len > parts[i].iov_len)
+            len = parts[i].iov_len;
+        rt_memcpy(parts[i].iov_base, (rt_uint8_t *) args->msg_obj + offset, len);
+        offset += len;
+    }
+
+    return offset;
+}
+
+/* the messages of the due schedules, published once msg_tlck has been released(msg_mb thread only) */
+struct task_msg_schedule_batch
+{
+    rt_uint8_t count;
+    struct
+    {
+        task_msg_args_t args;           /* the copy of a fixed message */
+        task_msg_schedule_t producer;   /* or the schedule whose produce makes it, RT_NULL once deleted */
+    } item[TASK_MSG_SCHEDULE_BURST_MAX + 8];
+};
+static struct task_msg_schedule_batch scheduled_batch;
+
+/**
+ * Unlink a schedule from the slist:msg_timer_slist, it is no longer the scheduled message or
+ * the debounce schedule of its message name(msg_tlck must be held).
+ *
+ * @param node: schedule
+ * @return RT_TRUE:unlinked, RT_FALSE:not found
+ */
+static rt_bool_t scheduled_node_take(task_msg_timer_node_t node)
+{
+    task_msg_timer_node_t item;
+    rt_slist_for_each_entry(item, &msg_timer_slist, slist)
+    {
+        if (item == node)
+        {
+            enum task_msg_name msg_name = item->args->msg_name;
+            rt_slist_remove(&msg_timer_slist, &(item->slist));
+            if (scheduled_array[msg_name] == item)
+                scheduled_array[msg_name] = RT_NULL;
+            if (debounce_array[msg_name] == item)
+                debounce_array[msg_name] = RT_NULL;
+            //its produce shall not be called any more
+            for (int i = 0; i < scheduled_batch.count; i++)
+            {
+                if (scheduled_batch.item[i].producer == item)
+                    scheduled_batch.item[i].producer = RT_NULL;
+            }
+            return RT_TRUE;
+        }
+    }
+    return RT_FALSE;
+}
+
+/**
+ * Free an unlinked schedule.
+ * @param node: schedule
+ */
+static void scheduled_node_free(task_msg_timer_node_t node)
+{
+    task_msg_args_free(node->args);
+    rt_free(node);
+}
+
+/**
+ * Wake up the msg_mb thread to recompute the tick it waits for(can be used in ISR).
+ * @return error code
+ */
+static rt_err_t scheduled_wakeup(void)
+{
+    //0 only wakes it up, a full mailbox will wake it up as well
+    rt_err_t rst = rt_mb_send(&msg_mb, 0);
+    return rst == -RT_EFULL ? RT_EOK : rst;
+}
+
+/**
+ * Create a schedule of the message name, a message name can have any number of schedules,
+ * the schedule is stopped until task_msg_schedule_start(shall not be used in ISR).
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object(copied)
+ * @param msg_size: message size
+ * @return the schedule handle, RT_NULL if failed
+ */
+task_msg_schedule_t task_msg_schedule_create(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+{
+    if (task_msg_bus_init_tag == RT_FALSE || msg_name >= TASK_MSG_COUNT)
+        return RT_NULL;
+
+    task_msg_timer_node_t node = rt_calloc(1, sizeof(struct task_msg_timer_node));
+    if (node == RT_NULL)
+    {
+        LOG_E("task msg schedule create failed! timer_node create failed!");
+        return RT_NULL;
+    }
+
+    task_msg_args_t msg_args = task_msg_args_create(msg_name, msg_obj, msg_size);
+    if (msg_args == RT_NULL)
+    {
+        rt_free(node);
+        LOG_E("task msg schedule create failed! msg_args create failed!");
+        return RT_NULL;
+    }
+
+    node->args = msg_args;
+    node->stop = RT_TRUE;
+    node->catchup = TASK_MSG_CATCHUP_SKIP;
+    rt_slist_init(&(node->slist));
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    rt_slist_append(&msg_timer_slist, &(node->slist));
+    rt_mutex_release(&msg_tlck);
+
+    return node;
+}
+
+/**
+ * Create a schedule whose message is made by produce when it is due instead of being fixed,
+ * e.g. the result of a window. produce runs in the msg_mb thread without the schedule lock held, so it may
+ * use the schedule API, and returns a message allocated by task_msg_args_alloc, or RT_NULL to publish
+ * nothing for this period. Once task_msg_schedule_delete returns, produce is not running and will not be
+ * called again, so parameter can be freed then(shall not be used in ISR).
+ *
+ * @param msg_name: message name
+ * @param produce: makes the message
+ * @param parameter: the parameter of produce
+ * @return the schedule handle, RT_NULL if failed
+ */
+task_msg_schedule_t task_msg_schedule_create_producer(enum task_msg_name msg_name,
+        task_msg_args_t (*produce)(void *parameter), void *parameter)
+{
+    if (produce == RT_NULL)
+        return RT_NULL;
+
+    task_msg_schedule_t schedule = task_msg_schedule_create(msg_name, RT_NULL, 0);
+    if (schedule)
+    {
+        rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+        schedule->produce = produce;
+        schedule->parameter = parameter;
+        rt_mutex_release(&msg_tlck);
+    }
+
+    return schedule;
+}
+
+/**
+ * Replace the message of a schedule, a running schedule keeps its periods(shall not be used in ISR).
+ *
+ * @param schedule: schedule handle
+ * @param msg_obj: message object(copied)
+ * @param msg_size: message size
+ * @return error code
+ */
+rt_err_t task_msg_schedule_update(task_msg_schedule_t schedule, void *msg_obj, rt_size_t msg_size)
+{
+    if (schedule == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    enum task_msg_name msg_name = schedule->args->msg_name;
+    rt_mutex_release(&msg_tlck);
+
+    task_msg_args_t msg_args = task_msg_args_create(msg_name, msg_obj, msg_size);
+    if (msg_args == RT_NULL)
+    {
+        LOG_E("task msg schedule update failed! msg_args create failed!");
+        return -RT_ENOMEM;
+    }
+
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    task_msg_args_t old_args = schedule->args;
+    schedule->args = msg_args;
+    rt_mutex_release(&msg_tlck);
+    task_msg_args_free(old_args);
+
+    return RT_EOK;
+}
+
+/**
+ * Start a schedule, the periods are counted from the first due tick, so the lateness of one period
+ * does not shift the following ones.
+ *
+ * @param schedule: schedule handle
+ * @param delay_ms: delay time(ms)
+ * @param repeat: repeat count(0:infinite)
+ * @param interval_ms: interval time(ms)
+ * @return error code
+ */
+rt_err_t task_msg_schedule_start(task_msg_schedule_t schedule, int delay_ms, rt_uint32_t repeat, int interval_ms)
+{
+    if (schedule == RT_NULL || delay_ms < 0 || interval_ms < 0)
+        return -RT_EINVAL;
+
+    rt_tick_t interval = rt_tick_from_millisecond(interval_ms);
+    //a repeated schedule needs a period of one tick at least
+    if (repeat != 1 && interval == 0)
+        interval = 1;
+
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    schedule->interval = interval;
+    schedule->repeat = repeat;
+    schedule->do_count = 0;
+    schedule->next = rt_tick_get() + rt_tick_from_millisecond(delay_ms);
+    schedule->stop = RT_FALSE;
+    rt_mutex_release(&msg_tlck);
+
+    return scheduled_wakeup();
+}
+
+/**
+ * Publish the message of a schedule at once(can be used in ISR), a running schedule restarts
+ * its period from now, a stopped one stays stopped.
+ *
+ * @param schedule: schedule handle
+ * @return error code
+ */
+rt_err_t task_msg_schedule_restart(task_msg_schedule_t schedule)
+{
+    if (schedule == RT_NULL)
+        return -RT_EINVAL;
+
+    schedule->restart = RT_TRUE;
+    return scheduled_wakeup();
+}
+
+/**
+ * Stop a schedule.
+ * @param schedule: schedule handle
+ * @return error code
+ */
+rt_err_t task_msg_schedule_stop(task_msg_schedule_t schedule)
+{
+    if (schedule == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    schedule->stop = RT_TRUE;
+    rt_mutex_release(&msg_tlck);
+
+    return RT_EOK;
+}
+
+/**
+ * Set how a schedule catches up with the periods missed while the msg_mb thread was late.
+ *
+ * @param schedule: schedule handle
+ * @param catchup: catch-up policy(default:TASK_MSG_CATCHUP_SKIP)
+ * @return error code
+ */
+rt_err_t task_msg_schedule_catchup_set(task_msg_schedule_t schedule, enum task_msg_catchup catchup)
+{
+    if (schedule == RT_NULL || catchup > TASK_MSG_CATCHUP_COALESCE)
+        return -RT_EINVAL;
+
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    schedule->catchup = catchup;
+    rt_mutex_release(&msg_tlck);
+
+    return RT_EOK;
+}
+
+/**
+ * Get the statistics of a schedule.
+ *
+ * @param schedule: schedule handle
+ * @param stats: the statistics
+ * @return error code
+ */
+rt_err_t task_msg_schedule_stats_get(task_msg_schedule_t schedule, struct task_msg_schedule_stats *stats)
+{
+    if (schedule == RT_NULL || stats == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    *stats = schedule->stats;
+    stats->lateness_avg = schedule->lateness_count ? schedule->lateness_sum / schedule->lateness_count : 0;
+    rt_mutex_release(&msg_tlck);
+
+    return RT_EOK;
+}
+
+/**
+ * Delete a schedule, the handle shall not be used any more.
+ * @param schedule: schedule handle
+ */
+void task_msg_schedule_delete(task_msg_schedule_t schedule)
+{
+    if (schedule == RT_NULL)
+        return;
+
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    rt_bool_t found = scheduled_node_take(schedule);
+    rt_bool_t producer = found && schedule->produce != RT_NULL;
+    rt_mutex_release(&msg_tlck);
+    if (found)
+    {
+        scheduled_node_free(schedule);
+    }
+    if (producer)
+    {
+        //wait for a produce still running in the msg_mb thread(passes at once in the msg_mb thread itself)
+        rt_mutex_take(&msg_plck, RT_WAITING_FOREVER);
+        rt_mutex_release(&msg_plck);
+    }
+}
+
+/**
+ * Copy the message of a schedule into the batch, or note its producer(msg_tlck must be held).
+ *
+ * @param item: schedule
+ * @param lateness: ticks since the due tick
+ * @param batch: the messages to be published
+ */
+static void scheduled_publish(task_msg_timer_node_t item, rt_tick_t lateness, struct task_msg_schedule_batch *batch)
+{
+    enum task_msg_name name = item->args->msg_name;
+    TASK_MSG_TRACE(TIMER_FIRE, name, -1, lateness);
+    if (debounce_array[name] == item)
+    {
+        rt_base_t level = rt_hw_interrupt_disable();
+        policy_array[name].debounce_pending = RT_FALSE;
+        rt_hw_interrupt_enable(level);
+    }
+    RT_ASSERT(batch->count < sizeof(batch->item) / sizeof(batch->item[0]));
+    if (item->produce)
+    {
+        //the produce is called once msg_tlck is released
+        batch->item[batch->count].args = RT_NULL;
+        batch->item[batch->count++].producer = item;
+    }
+    else
+    {
+        //a copy, the schedule may be updated or deleted before it is published
+        task_msg_args_t args = task_msg_args_create(name, item->args->msg_obj, item->args->msg_size);
+        if (args == RT_NULL)
+        {
+            LOG_E("task msg publish failed! msg_args create failed!");
+            TASK_MSG_TRACE(DROP, name, -1, 0);
+        }
+        else
+        {
+            args->origin = item->args->origin;
+            batch->item[batch->count].args = args;
+            batch->item[batch->count++].producer = RT_NULL;
+        }
+    }
+    item->stats.fired++;
+}
+
+/**
+ * Collect the messages of a due schedule and move it to its next period(msg_tlck must be held).
  *
- * @param msg_name: message name
- * @param msg_obj: message object
- * @param msg_size: message size
- * @return error code
+ * @param item: schedule
+ * @param now: current tick
+ * @param batch: the messages to be published
  */
-rt_err_t task_msg_publish_obj(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
+static void scheduled_fire(task_msg_timer_node_t item, rt_tick_t now, struct task_msg_schedule_batch *batch)
 {
-    if (task_msg_bus_init_tag == RT_FALSE)
-        return -RT_EINVAL;
+    rt_tick_t lateness = now - item->next;
+    item->stats.lateness_last = lateness;
+    if (lateness > item->stats.lateness_max)
+        item->stats.lateness_max = lateness;
+    item->lateness_sum += lateness;
+    item->lateness_count++;
+    scheduled_publish(item, lateness, batch);
+    item->do_count++;
 
-    task_msg_args_node_t node = rt_calloc(1, sizeof(struct task_msg_args_node));
-    if (node == RT_NULL)
+    //the periods which have become due meanwhile
+    rt_uint32_t missed = 0;
+    item->next += item->interval;
+    if (item->interval > 0 && (rt_int32_t) (now - item->next) >= 0)
     {
-        LOG_E("task msg publish failed! args_node create failed!");
-        return -RT_ENOMEM;
+        missed = (now - item->next) / item->interval + 1;
+    }
+    if (item->repeat > 0 && missed > item->repeat - item->do_count)
+    {
+        missed = item->repeat - item->do_count;
     }
 
-    task_msg_args_t msg_args = rt_calloc(1, sizeof(struct task_msg_args));
-    if (msg_args == RT_NULL)
+    switch (item->catchup)
     {
-        rt_free(node);
-        LOG_E("task msg publish failed! msg_args create failed!");
-        return -RT_ENOMEM;
+    case TASK_MSG_CATCHUP_BURST:
+        for (rt_uint32_t i = 0; i < missed; i++)
+        {
+            if (i < TASK_MSG_SCHEDULE_BURST_MAX)
+                scheduled_publish(item, lateness, batch);
+            else
+                item->stats.missed++;
+        }
+        item->do_count += missed;
+        item->next += missed * item->interval;
+        break;
+    case TASK_MSG_CATCHUP_COALESCE:
+        item->stats.missed += missed;
+        if (missed > 0)
+            item->next = now + item->interval;
+        break;
+    default:
+        item->stats.missed += missed;
+        item->do_count += missed;
+        item->next += missed * item->interval;
+        break;
     }
 
-    msg_args->msg_name = msg_name;
-    msg_args->msg_size = msg_size;
-    msg_args->msg_obj = RT_NULL;
-    if (msg_obj && msg_size > 0)
+    if (item->repeat > 0 && item->do_count >= item->repeat)
     {
-#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
-        if (dup_release_hooks[msg_name].dup)
+        item->stop = RT_TRUE;
+    }
+}
+
+/**
+ * Publish the due and the restarted schedules. The messages are collected under msg_tlck and published
+ * after it is released, so the callbacks of direct messages may create or delete schedules.
+ *
+ * @return ticks until the next due tick, RT_WAITING_FOREVER if no schedule is running
+ */
+static rt_int32_t scheduled_poll(void)
+{
+    rt_int32_t timeout = RT_WAITING_FOREVER;
+    struct task_msg_schedule_batch *batch = &scheduled_batch;
+    task_msg_timer_node_t item;
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    batch->count = 0;
+    rt_slist_for_each_entry(item, &msg_timer_slist, slist)
+    {
+        //the batch may not hold all the messages of this schedule: publish it and come back at once
+        rt_uint32_t need = (item->catchup == TASK_MSG_CATCHUP_BURST) ? TASK_MSG_SCHEDULE_BURST_MAX + 1 : 1;
+        if (batch->count + need > sizeof(batch->item) / sizeof(batch->item[0]))
         {
-            RT_ASSERT(dup_release_hooks[msg_name].msg_name == msg_name);
-            msg_args->msg_obj = dup_release_hooks[msg_name].dup(msg_obj);
-            if (msg_args->msg_obj == RT_NULL)
-            {
-                rt_free(node);
-                rt_free(msg_args);
-                LOG_E("task msg publish failed! msg_args create failed!");
-                return -RT_ENOMEM;
-            }
+            timeout = 0;
+            break;
         }
-        else
+
+        rt_tick_t now = rt_tick_get();
+        rt_base_t level = rt_hw_interrupt_disable();
+        rt_bool_t restart = item->restart;
+        item->restart = RT_FALSE;
+        rt_hw_interrupt_enable(level);
+        if (restart)
         {
-            msg_args->msg_obj = rt_calloc(1, msg_size);
-            if (msg_args->msg_obj)
-            {
-                rt_memcpy(msg_args->msg_obj, msg_obj, msg_size);
-            }
+            if (item->stop)
+                scheduled_publish(item, 0, batch);
             else
-            {
-                rt_free(node);
-                rt_free(msg_args);
-                LOG_E("task msg publish failed! msg_args create failed!");
-                return -RT_ENOMEM;
-            }
+                item->next = now;
         }
-#else
-        msg_args->msg_obj = rt_calloc(1, msg_size);
-        if (msg_args->msg_obj)
+        if (item->stop)
+            continue;
+
+        if ((rt_int32_t) (item->next - now) <= 0)
         {
-            rt_memcpy(msg_args->msg_obj, msg_obj, msg_size);
+            scheduled_fire(item, now, batch);
+            if (item->stop)
+                continue;
         }
-        else
+        rt_int32_t remain = (rt_int32_t) (item->next - now);
+        if (timeout == RT_WAITING_FOREVER || remain < timeout)
+            timeout = remain;
+    }
+    int count = batch->count;
+    rt_mutex_release(&msg_tlck);
+
+    rt_mutex_take(&msg_plck, RT_WAITING_FOREVER);
+    for (int i = 0; i < count; i++)
+    {
+        //a producer schedule may be deleted by a callback or another thread meanwhile
+        rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+        task_msg_args_t args = batch->item[i].args;
+        task_msg_schedule_t producer = batch->item[i].producer;
+        task_msg_args_t (*produce)(void *parameter) = producer ? producer->produce : RT_NULL;
+        void *parameter = producer ? producer->parameter : RT_NULL;
+        rt_mutex_release(&msg_tlck);
+
+        if (produce)
         {
-            rt_free(node);
-            rt_free(msg_args);
-            LOG_E("task msg publish failed! msg_args create failed!");
-            return -RT_ENOMEM;
+            args = produce(parameter);
+        }
+        //scheduled and debounced messages bypass the publish policy
+        if (args)
+        {
+            task_msg_publish_args_internal(args);
         }
-#endif
     }
-    node->args = msg_args;
-    rt_slist_init(&(node->slist));
-    rt_mutex_take(&msg_lock, RT_WAITING_FOREVER);
-    rt_slist_append(&msg_slist, &(node->slist));
-    rt_mutex_release(&msg_lock);
-
-    rt_sem_release(&msg_sem);
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    batch->count = 0;
+    rt_mutex_release(&msg_tlck);
+    rt_mutex_release(&msg_plck);
 
-    return RT_EOK;
+    return timeout;
 }
 
 /**
- * Append or update a scheduled message(shall not be used in ISR).
+ * Append or update the scheduled message of the message name(shall not be used in ISR),
+ * a running scheduled message keeps its periods.
  *
  * @param msg_name: message name
  * @param msg_obj: message object
@@ -481,87 +2838,24 @@ rt_err_t task_msg_publish_obj(enum task_msg_name msg_name, void *msg_obj, rt_siz
  */
 rt_err_t task_msg_scheduled_append(enum task_msg_name msg_name, void *msg_obj, rt_size_t msg_size)
 {
-    if (task_msg_bus_init_tag == RT_FALSE)
+    if (task_msg_bus_init_tag == RT_FALSE || msg_name >= TASK_MSG_COUNT)
         return -RT_EINVAL;
 
-    task_msg_timer_node_t node = rt_calloc(1, sizeof(struct task_msg_timer_node));
-    if (node == RT_NULL)
-    {
-        LOG_E("task msg scheduled append failed! timer_node create failed!");
-        return -RT_ENOMEM;
-    }
-
-    task_msg_args_t msg_args = rt_calloc(1, sizeof(struct task_msg_args));
-    if (msg_args == RT_NULL)
+    rt_err_t rst = RT_EOK;
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    if (scheduled_array[msg_name])
     {
-        rt_free(node);
-        LOG_E("task msg scheduled append failed! msg_args create failed!");
-        return -RT_ENOMEM;
+        rst = task_msg_schedule_update(scheduled_array[msg_name], msg_obj, msg_size);
     }
-
-    msg_args->msg_name = msg_name;
-    msg_args->msg_size = msg_size;
-    msg_args->msg_obj = RT_NULL;
-    if (msg_obj && msg_size > 0)
+    else
     {
-#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
-        if (dup_release_hooks[msg_name].dup)
-        {
-            RT_ASSERT(dup_release_hooks[msg_name].msg_name == msg_name);
-            msg_args->msg_obj = dup_release_hooks[msg_name].dup(msg_obj);
-            if (msg_args->msg_obj == RT_NULL)
-            {
-                rt_free(node);
-                rt_free(msg_args);
-                LOG_E("task msg scheduled append failed! msg_args create failed!");
-                return -RT_ENOMEM;
-            }
-        }
-        else
-        {
-            msg_args->msg_obj = rt_calloc(1, msg_size);
-            if (msg_args->msg_obj)
-            {
-                rt_memcpy(msg_args->msg_obj, msg_obj, msg_size);
-            }
-            else
-            {
-                rt_free(node);
-                rt_free(msg_args);
-                LOG_E("task msg scheduled append failed! msg_args create failed!");
-                return -RT_ENOMEM;
-            }
-        }
-#else
-        msg_args->msg_obj = rt_calloc(1, msg_size);
-        if (msg_args->msg_obj)
-        {
-            rt_memcpy(msg_args->msg_obj, msg_obj, msg_size);
-        }
-        else
-        {
-            rt_free(node);
-            rt_free(msg_args);
-            LOG_E("task msg scheduled append failed! msg_args create failed!");
-            return -RT_ENOMEM;
-        }
-#endif
+        scheduled_array[msg_name] = task_msg_schedule_create(msg_name, msg_obj, msg_size);
+        if (scheduled_array[msg_name] == RT_NULL)
+            rst = -RT_ENOMEM;
     }
-    node->args = msg_args;
-    rt_slist_init(&(node->slist));
-    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
-    task_msg_scheduled_delete(msg_name);
-    rt_slist_append(&msg_timer_slist, &(node->slist));
     rt_mutex_release(&msg_tlck);
 
-    return RT_EOK;
-}
-
-static void scheduled_timeout_callback(void *params)
-{
-    task_msg_timer_node_t item = (task_msg_timer_node_t) params;
-    rt_ubase_t msg_name = (rt_ubase_t) (item->args->msg_name);
-    rt_mb_send(&msg_mb, msg_name);
+    return rst;
 }
 /**
  * Restart a schedule message(can be used in ISR)
@@ -570,7 +2864,10 @@ static void scheduled_timeout_callback(void *params)
  */
 rt_err_t task_msg_scheduled_restart(enum task_msg_name msg_name)
 {
-    rt_mb_send(&msg_mb, (rt_ubase_t) msg_name);
+    if (msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+    //msg_name + 1 restarts the scheduled message of the message name in the msg_mb thread
+    return rt_mb_send(&msg_mb, (rt_ubase_t) msg_name + 1);
 }
 /**
  * Start a schedule message, if it has not been added before, a message without parameters will be automatically added
@@ -582,46 +2879,20 @@ rt_err_t task_msg_scheduled_restart(enum task_msg_name msg_name)
  */
 rt_err_t task_msg_scheduled_start(enum task_msg_name msg_name, int delay_ms, rt_uint32_t repeat, int interval_ms)
 {
-    rt_err_t res;
-    rt_bool_t msg_exist = RT_FALSE;
-    task_msg_timer_node_t item;
+    if (msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
+    rt_err_t res = RT_EOK;
     rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(item, &msg_timer_slist, slist)
+    if (scheduled_array[msg_name] == RT_NULL)
     {
-        if (item->args->msg_name == msg_name)
-        {
-            msg_exist = RT_TRUE;
-            item->interval = rt_tick_from_millisecond(interval_ms);
-            item->repeat = repeat;
-            item->do_count = 0;
-            int delay_tick = rt_tick_from_millisecond(delay_ms);
-            if (rt_object_get_type(&(item->timer.parent)) == RT_Object_Class_Timer)
-            {
-                rt_timer_control(&(item->timer), RT_TIMER_CTRL_SET_TIME, &delay_tick);
-                rt_timer_control(&(item->timer), RT_TIMER_CTRL_SET_ONESHOT, RT_NULL);
-            }
-            else
-            {
-                char name[RT_NAME_MAX];
-                rt_snprintf(name, RT_NAME_MAX, "sch%d", msg_name);
-                rt_timer_init(&(item->timer), name, scheduled_timeout_callback, item,
-                        rt_tick_from_millisecond(delay_ms),
-                        RT_TIMER_FLAG_ONE_SHOT | RT_TIMER_FLAG_SOFT_TIMER);
-            }
-            res = rt_timer_start(&(item->timer));
-            item->stop = RT_FALSE;
-            break;
-        }
+        res = task_msg_scheduled_append(msg_name, RT_NULL, 0);
     }
-    rt_mutex_release(&msg_tlck);
-    if (!msg_exist)
+    if (res == RT_EOK)
     {
-        res = task_msg_scheduled_append(msg_name, RT_NULL, 0);
-        if (res == RT_EOK)
-        {
-            res = task_msg_scheduled_start(msg_name, delay_ms, repeat, interval_ms);
-        }
+        res = task_msg_schedule_start(scheduled_array[msg_name], delay_ms, repeat, interval_ms);
     }
+    rt_mutex_release(&msg_tlck);
     return res;
 }
 /**
@@ -631,23 +2902,16 @@ rt_err_t task_msg_scheduled_start(enum task_msg_name msg_name, int delay_ms, rt_
  */
 rt_err_t task_msg_scheduled_stop(enum task_msg_name msg_name)
 {
-    rt_err_t res = RT_EOK;
-    task_msg_timer_node_t item;
+    if (msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
     rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(item, &msg_timer_slist, slist)
+    if (scheduled_array[msg_name])
     {
-        if (item->args->msg_name == msg_name)
-        {
-            if (rt_object_get_type(&(item->timer.parent)) == RT_Object_Class_Timer)
-            {
-                res = rt_timer_stop(&(item->timer));
-                item->stop = RT_TRUE;
-            }
-            break;
-        }
+        scheduled_array[msg_name]->stop = RT_TRUE;
     }
     rt_mutex_release(&msg_tlck);
-    return res;
+    return RT_EOK;
 }
 /**
  * Delete a schedule message
@@ -655,34 +2919,20 @@ rt_err_t task_msg_scheduled_stop(enum task_msg_name msg_name)
  */
 void task_msg_scheduled_delete(enum task_msg_name msg_name)
 {
-    task_msg_timer_node_t item;
+    if (msg_name >= TASK_MSG_COUNT)
+        return;
+
     rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
-    rt_slist_for_each_entry(item, &msg_timer_slist, slist)
+    task_msg_timer_node_t node = scheduled_array[msg_name];
+    if (node)
     {
-        if (item->args->msg_name == msg_name)
-        {
-            rt_slist_remove(&msg_timer_slist, &(item->slist));
-            if (item->args->msg_obj)
-            {
-#ifdef TASK_MSG_USING_DYNAMIC_MEMORY
-                if (dup_release_hooks[item->args->msg_name].release)
-                {
-                    RT_ASSERT(dup_release_hooks[item->args->msg_name].msg_name == item->args->msg_name);
-                    dup_release_hooks[item->args->msg_name].release(item->args->msg_obj);
-                }
-#endif
-                rt_free(item->args->msg_obj);
-            }
-            rt_free(item->args);
-            if (rt_object_get_type(&(item->timer.parent)) == RT_Object_Class_Timer)
-            {
-                rt_timer_detach(&(item->timer));
-            }
-            rt_free(item);
-            break;
-        }
+        scheduled_node_take(node);
     }
     rt_mutex_release(&msg_tlck);
+    if (node)
+    {
+        scheduled_node_free(node);
+    }
 }
 /**
  * Publish a text message(shall not be used in ISR).
@@ -701,19 +2951,6 @@ rt_err_t task_msg_publish(enum task_msg_name msg_name, const char *msg_text)
     }
     return task_msg_publish_obj(msg_name, msg_obj, args_size);
 }
-/**
- * Initialize the callback slist array.
- */
-static void task_msg_callback_init(void)
-{
-    rt_mutex_take(&cb_lock, RT_WAITING_FOREVER);
-    for (int i = 0; i < TASK_MSG_COUNT; i++)
-    {
-        callback_slist_array[i].next = RT_NULL;
-    }
-    rt_mutex_release(&cb_lock);
-}
-
 /**
  * Task message bus thread entry.
  * @param params
@@ -724,57 +2961,25 @@ static void task_msg_bus_thread_entry(void *params)
     {
         if (rt_sem_take(&msg_sem, RT_WAITING_FOREVER) == RT_EOK)
         {
-            task_msg_args_node_t msg_args_node;
-            task_msg_callback_node_t msg_callback_node;
-            task_msg_subscriber_node_t subscriber;
-            task_msg_wait_node_t msg_wait_node;
+            task_msg_args_node_t msg_args_node = RT_NULL;
+            //get and remove msg
+            rt_mutex_take(&msg_lock, RT_WAITING_FOREVER);
             if (rt_slist_len(&msg_slist) > 0)
             {
-                //get msg
                 msg_args_node = rt_slist_first_entry(&msg_slist, struct task_msg_args_node, slist);
-                msg_ref_append(msg_args_node->args);
-
-                rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
-                rt_slist_for_each_entry(subscriber, &msg_subscriber_slist, slist)
+                rt_slist_remove(&msg_slist, &(msg_args_node->slist));
+            }
+            rt_mutex_release(&msg_lock);
+            if (msg_args_node)
+            {
+                if (task_msg_args_expired(msg_args_node->args))
                 {
-                    if (subscriber->msg_name == msg_args_node->args->msg_name)
-                    {
-                        msg_wait_node = rt_calloc(1, sizeof(struct task_msg_wait_node));
-                        if (msg_wait_node == RT_NULL)
-                        {
-                            LOG_W("no memory to create msg_wait_node!");
-                            break;
-                        }
-
-                        msg_ref_append(msg_args_node->args);
-                        msg_wait_node->subscriber = subscriber;
-                        msg_wait_node->args = msg_args_node->args;
-                        rt_slist_init(&(msg_wait_node->slist));
-                        rt_mutex_take(&wt_lock, RT_WAITING_FOREVER);
-                        rt_slist_append(&msg_wait_slist, &(msg_wait_node->slist));
-                        rt_mutex_release(&wt_lock);
-
-                        rt_sem_release(subscriber->sem);
-                    }
+                    task_msg_args_expire(msg_args_node->args, -1);
                 }
-                rt_mutex_release(&sub_lock);
-
-                //msg callback
-                rt_mutex_take(&cb_lock, RT_WAITING_FOREVER);
-                rt_slist_for_each_entry(msg_callback_node, &callback_slist_array[msg_args_node->args->msg_name], slist)
+                else
                 {
-                    if (msg_callback_node->callback)
-                    {
-                        msg_callback_node->callback(msg_args_node->args);
-                    }
+                    task_msg_dispatch(msg_args_node->args);
                 }
-                rt_mutex_release(&cb_lock);
-                //remove msg
-                rt_mutex_take(&msg_lock, RT_WAITING_FOREVER);
-                rt_slist_remove(&msg_slist, &(msg_args_node->slist));
-                rt_mutex_release(&msg_lock);
-                //release msg
-                task_msg_release(msg_args_node->args);
                 rt_free(msg_args_node);
             }
         }
@@ -783,64 +2988,55 @@ static void task_msg_bus_thread_entry(void *params)
 
 static void task_msg_mb_thread_entry(void *params)
 {
-    rt_ubase_t msg_name;
+    rt_ubase_t value;
     while (1)
     {
-        if (rt_mb_recv(&msg_mb, &msg_name, RT_WAITING_FOREVER) == RT_EOK)
+        //wait for the next due tick, a new schedule or a restart
+        rt_int32_t timeout = scheduled_poll();
+        if (rt_mb_recv(&msg_mb, &value, timeout) == RT_EOK && value > 0 && value <= TASK_MSG_COUNT)
         {
-            enum task_msg_name name = (enum task_msg_name) msg_name;
-            task_msg_timer_node_t item;
             rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
-            rt_slist_for_each_entry(item, &msg_timer_slist, slist)
+            if (scheduled_array[value - 1])
             {
-                if (item->args->msg_name == name)
-                {
-                    rt_bool_t resend = RT_FALSE;
-                    task_msg_publish_obj(name, item->args->msg_obj, item->args->msg_size);
-                    if (item->stop)
-                    { //停止
-                        resend = RT_FALSE;
-                    }
-                    else if (item->repeat == 0)
-                    { //无限重复
-                        item->do_count++;
-                        resend = RT_TRUE;
-                    }
-                    else
-                    {
-                        item->do_count++;
-                        if (item->do_count < item->repeat)
-                        {
-                            resend = RT_TRUE;
-                        }
-                        else
-                        {
-                            resend = RT_FALSE;
-                        }
-                    }
-                    if (resend)
-                    {
-                        if (item->do_count == 1)
-                        {
-                            rt_timer_control(&(item->timer), RT_TIMER_CTRL_SET_TIME, &(item->interval));
-                            rt_timer_control(&(item->timer), RT_TIMER_CTRL_SET_PERIODIC, RT_NULL);
-                        }
-                        rt_timer_start(&(item->timer));
-                        item->stop = RT_FALSE;
-                    }
-                    else if (!item->stop)
-                    {
-                        rt_timer_stop(&(item->timer));
-                        item->stop = RT_TRUE;
-                    }
-                    break;
-                }
+                scheduled_array[value - 1]->restart = RT_TRUE;
             }
             rt_mutex_release(&msg_tlck);
         }
     }
 }
 
+#if TASK_MSG_EARLY_BUFFER_SIZE > 0
+/**
+ * Publish the messages kept by task_msg_early_append in order, the messages appended meanwhile are published too,
+ * then mark the bus initialized in the same critical section that finds the buffer drained,
+ * so no message published before that overtakes a kept one.
+ */
+static void task_msg_early_flush(void)
+{
+    rt_size_t offset = 0;
+    while (1)
+    {
+        rt_base_t level = rt_hw_interrupt_disable();
+        if (offset >= early_used)
+        {
+            early_used = 0;
+            task_msg_bus_init_tag = RT_TRUE;
+            rt_hw_interrupt_enable(level);
+            break;
+        }
+        struct task_msg_early_record *record = (struct task_msg_early_record *) ((rt_uint8_t *) early_buffer + offset);
+        rt_hw_interrupt_enable(level);
+
+        if (task_msg_publish_obj_policy((enum task_msg_name) record->msg_name, record->msg_size ? record + 1 : RT_NULL,
+                record->msg_size) != RT_EOK)
+        {
+            LOG_W("msg_name[%d] published before the bus initialized is dropped!", record->msg_name);
+        }
+        offset += RT_ALIGN(sizeof(struct task_msg_early_record) + record->msg_size, sizeof(rt_uint32_t));
+    }
+}
+#endif
+
 /**
  * Initialize message bus components.
  *
@@ -855,15 +3051,18 @@ int task_msg_bus_init(void)
         return -RT_EBUSY;
 
     rt_sem_init(&msg_sem, "msg_sem", 0, RT_IPC_FLAG_FIFO);
-    rt_mb_init(&msg_mb, "msg_mb", &mbpool[0], sizeof(mbpool) / 4, RT_IPC_FLAG_FIFO);
+    rt_mb_init(&msg_mb, "msg_mb", &mbpool[0], sizeof(mbpool) / sizeof(rt_ubase_t), RT_IPC_FLAG_FIFO);
     rt_mutex_init(&msg_lock, "msg_lock", RT_IPC_FLAG_FIFO);
     rt_mutex_init(&msg_tlck, "msg_tlck", RT_IPC_FLAG_FIFO);
-    rt_mutex_init(&msg_ref_lock, "ref_lock", RT_IPC_FLAG_FIFO);
+    rt_mutex_init(&msg_plck, "msg_plck", RT_IPC_FLAG_FIFO);
     rt_mutex_init(&cb_lock, "cb_lock", RT_IPC_FLAG_FIFO);
-    rt_mutex_init(&wt_lock, "wt_lock", RT_IPC_FLAG_FIFO);
     rt_mutex_init(&sub_lock, "sub_lock", RT_IPC_FLAG_FIFO);
-    task_msg_callback_init();
+    rt_mutex_init(&dec_lock, "dec_lock", RT_IPC_FLAG_FIFO);
+#if TASK_MSG_EARLY_BUFFER_SIZE > 0
+    task_msg_early_flush();
+#else
     task_msg_bus_init_tag = RT_TRUE;
+#endif
 
     rt_thread_t t1 = rt_thread_create("msg_bus", task_msg_bus_thread_entry,
     RT_NULL, TASK_MSG_THREAD_STACK_SIZE, TASK_MSG_THREAD_PRIORITY, 80);
@@ -873,7 +3072,7 @@ int task_msg_bus_init(void)
         return -RT_ENOMEM;
     }
     rt_thread_t t2 = rt_thread_create("msg_mb", task_msg_mb_thread_entry,
-    RT_NULL, TASK_MSG_THREAD_STACK_SIZE, TASK_MSG_THREAD_PRIORITY, 20);
+    RT_NULL, TASK_MSG_MB_THREAD_STACK_SIZE, TASK_MSG_THREAD_PRIORITY, 20);
     if (t2 == RT_NULL)
     {
         LOG_E("task msg bus initialize failed! msg_mb_thread create failed!");
@@ -896,3 +3095,42 @@ int task_msg_bus_init(void)
     return rst;
 }
 INIT_COMPONENT_EXPORT(task_msg_bus_init);
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+static int task_msg_stats(int argc, char **argv)
+{
+    struct task_msg_stats stats;
+    rt_kprintf("msg_name expired  suppressed debounced rejected bytes    budget\n");
+    for (int i = 0; i < TASK_MSG_COUNT; i++)
+    {
+        task_msg_stats_get((enum task_msg_name) i, &stats);
+        rt_kprintf("%-8d %-8d %-10d %-9d %-8d %-8d %-8d\n", i, stats.expired, stats.suppressed, stats.debounced,
+                stats.rejected, stats.bytes, stats.budget);
+    }
+    rt_kprintf("total bytes:%d budget:%d\n", mem_used, mem_budget);
+
+    task_msg_subscriber_t subscriber;
+    rt_kprintf("subscriber pending  bytes\n");
+    rt_mutex_take(&sub_lock, RT_WAITING_FOREVER);
+    rt_slist_for_each_entry(subscriber, &msg_subscriber_slist, slist)
+    {
+        rt_kprintf("%-10d %-8d %-8d\n", subscriber->subscriber_id, subscriber->pending_count,
+                subscriber->pending_bytes);
+    }
+    rt_mutex_release(&sub_lock);
+
+    task_msg_timer_node_t item;
+    rt_kprintf("msg_name state fired    missed   late_last late_max late_avg\n");
+    rt_mutex_take(&msg_tlck, RT_WAITING_FOREVER);
+    rt_slist_for_each_entry(item, &msg_timer_slist, slist)
+    {
+        rt_kprintf("%-8d %-5s %-8d %-8d %-9d %-8d %-8d\n", item->args->msg_name, item->stop ? "stop" : "run",
+                item->stats.fired, item->stats.missed, item->stats.lateness_last, item->stats.lateness_max,
+                item->lateness_count ? item->lateness_sum / item->lateness_count : 0);
+    }
+    rt_mutex_release(&msg_tlck);
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(task_msg_stats, task msg bus statistics of each message name and subscriber and schedule);
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+
+#include "task_msg_bus.h"
+#include "task_msg_loop.h"
+
+#ifdef TASK_MSG_USING_LOOP
+
+#define DBG_TAG "task.msg.loop"
+#define DBG_LVL DBG_INFO
+#include <rtdbg.h>
+
+struct task_msg_loop
+{
+    task_msg_subscriber_t subscriber;   /* the private queue of the loop */
+    void (*handler[TASK_MSG_COUNT])(task_msg_args_t msg_args);
+};
+
+/**
+ * Create an event loop, the callbacks subscribed by the loop are called in the thread running it
+ * instead of the msg_bus thread, so they may block without delaying the other subscribers.
+ *
+ * @return the loop, RT_NULL if failed
+ */
+task_msg_loop_t task_msg_loop_create(void)
+{
+    task_msg_loop_t loop = rt_calloc(1, sizeof(struct task_msg_loop));
+    if (loop == RT_NULL)
+    {
+        LOG_E("task msg loop create failed! there is no memory available!");
+        return RT_NULL;
+    }
+
+    loop->subscriber = task_msg_subscriber_open(RT_NULL, 0);
+    if (loop->subscriber == RT_NULL)
+    {
+        rt_free(loop);
+        LOG_E("task msg loop create failed! subscriber open failed!");
+        return RT_NULL;
+    }
+
+    return loop;
+}
+
+/**
+ * Subscribe the message with the specified name and set the callback function of the loop,
+ * a message name has one callback per loop, a later one replaces it.
+ *
+ * @param loop: event loop
+ * @param msg_name: message name
+ * @param callback: callback function name
+ * @return error code
+ */
+rt_err_t task_msg_loop_subscribe(task_msg_loop_t loop, enum task_msg_name msg_name,
+        void (*callback)(task_msg_args_t msg_args))
+{
+    if (loop == RT_NULL || msg_name >= TASK_MSG_COUNT || callback == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_bool_t subscribed = (loop->handler[msg_name] != RT_NULL);
+    loop->handler[msg_name] = callback;
+    if (subscribed)
+        return RT_EOK;
+
+    rt_err_t rst = task_msg_subscriber_add(loop->subscriber, msg_name);
+    if (rst != RT_EOK)
+    {
+        loop->handler[msg_name] = RT_NULL;
+    }
+    return rst;
+}
+
+/**
+ * Unsubscribe the message with the specified name of the loop,
+ * the messages of it already queued are released without calling any callback.
+ *
+ * @param loop: event loop
+ * @param msg_name: message name
+ * @return error code
+ */
+rt_err_t task_msg_loop_unsubscribe(task_msg_loop_t loop, enum task_msg_name msg_name)
+{
+    if (loop == RT_NULL || msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
+    loop->handler[msg_name] = RT_NULL;
+    return task_msg_subscriber_remove(loop->subscriber, msg_name);
+}
+
+/**
+ * Call the callback of a message in the current thread and release the message.
+ *
+ * @param loop: event loop
+ * @param args: message reference
+ */
+static void task_msg_loop_dispatch(task_msg_loop_t loop, task_msg_args_t args)
+{
+    void (*handler)(task_msg_args_t msg_args) = loop->handler[args->msg_name];
+    if (handler)
+    {
+        handler(args);
+    }
+    task_msg_release(args);
+}
+
+/**
+ * Wait for the messages of the loop at most timeout_ms, then call their callbacks in the current thread
+ * until no message is pending, for a thread which also has other work to do.
+ *
+ * @param loop: event loop
+ * @param timeout_ms: the waiting millisecond (-1:waiting forever until get resource)
+ * @return RT_EOK:some messages are handled, -RT_ETIMEOUT:no message, -RT_EINTR:task_msg_loop_quit
+ */
+rt_err_t task_msg_loop_run_once(task_msg_loop_t loop, rt_int32_t timeout_ms)
+{
+    if (loop == RT_NULL)
+        return -RT_EINVAL;
+
+    task_msg_args_t args;
+    rt_err_t rst = task_msg_subscriber_wait(loop->subscriber, timeout_ms, &args);
+    if (rst != RT_EOK)
+        return rst;
+
+    do
+    {
+        task_msg_loop_dispatch(loop, args);
+    } while ((rst = task_msg_subscriber_wait(loop->subscriber, 0, &args)) == RT_EOK);
+
+    return rst == -RT_EINTR ? rst : RT_EOK;
+}
+
+/**
+ * Run the loop in the current thread until task_msg_loop_quit.
+ *
+ * @param loop: event loop
+ * @return error code
+ */
+rt_err_t task_msg_loop_run(task_msg_loop_t loop)
+{
+    rt_err_t rst;
+    while ((rst = task_msg_loop_run_once(loop, RT_WAITING_FOREVER)) == RT_EOK)
+    {
+    }
+    return rst == -RT_EINTR ? RT_EOK : rst;
+}
+
+/**
+ * Make task_msg_loop_run return(can be used in ISR and in the callbacks),
+ * if the loop is not running, the next run returns at once.
+ *
+ * @param loop: event loop
+ * @return error code
+ */
+rt_err_t task_msg_loop_quit(task_msg_loop_t loop)
+{
+    if (loop == RT_NULL)
+        return -RT_EINVAL;
+
+    return task_msg_subscriber_interrupt(loop->subscriber);
+}
+
+/**
+ * Delete a loop which is not running, the unhandled messages are released.
+ * @param loop: event loop
+ */
+void task_msg_loop_delete(task_msg_loop_t loop)
+{
+    if (loop == RT_NULL)
+        return;
+
+    task_msg_subscriber_close(loop->subscriber);
+    rt_free(loop);
+}
+
+#endif
@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+
+#include "task_msg_bus.h"
+#include "task_msg_record.h"
+
+#ifdef TASK_MSG_USING_RECORD
+
+#include <dfs_posix.h>
+
+#define DBG_TAG "task.msg.record"
+#define DBG_LVL DBG_INFO
+#include <rtdbg.h>
+
+#ifndef TASK_MSG_RECORD_BUFFER_SIZE
+#define TASK_MSG_RECORD_BUFFER_SIZE 1024
+#endif
+#ifndef TASK_MSG_RECORD_FLUSH_MS
+#define TASK_MSG_RECORD_FLUSH_MS 1000
+#endif
+#ifndef TASK_MSG_RECORD_THREAD_STACK_SIZE
+#define TASK_MSG_RECORD_THREAD_STACK_SIZE 1024
+#endif
+#ifndef TASK_MSG_RECORD_THREAD_PRIORITY
+#define TASK_MSG_RECORD_THREAD_PRIORITY 20
+#endif
+#define TASK_MSG_REPLAY_PATH_MAX 64
+
+struct record_buffer
+{
+    rt_uint8_t data[TASK_MSG_RECORD_BUFFER_SIZE];
+    rt_size_t len;          /* bytes reserved */
+    rt_uint32_t writers;    /* captures still copying into the reserved bytes */
+};
+
+/* the buffers are switched with the interrupts disabled, so the publishers never block on a lock */
+static struct record_buffer record_buffers[2];
+static struct record_buffer *record_active = RT_NULL;
+static struct record_buffer *record_full = RT_NULL;
+static struct rt_semaphore record_sem;
+static struct task_msg_record_stats record_stats;
+static rt_bool_t record_init_tag = RT_FALSE;
+static volatile rt_bool_t record_running = RT_FALSE;
+static volatile rt_bool_t record_exit = RT_FALSE;
+static rt_thread_t record_thread = RT_NULL;
+static int record_fd = -1;
+
+static volatile rt_bool_t replay_running = RT_FALSE;
+static rt_bool_t replay_busy = RT_FALSE;  /* a replay thread is starting or running, cleared when it exits */
+
+static void record_init(void)
+{
+    if (record_init_tag)
+        return;
+
+    rt_sem_init(&record_sem, "rec_sem", 0, RT_IPC_FLAG_FIFO);
+    record_init_tag = RT_TRUE;
+}
+
+/**
+ * Write a buffer to the record file once the captures copying into it have finished.
+ */
+static void record_write(struct record_buffer *buffer)
+{
+    while (buffer->writers > 0)
+    {
+        rt_thread_delay(1);
+    }
+    if (buffer->len > 0 && record_fd >= 0)
+    {
+        if (write(record_fd, buffer->data, buffer->len) != (int) buffer->len)
+        {
+            LOG_E("record file write failed!");
+        }
+    }
+    rt_base_t level = rt_hw_interrupt_disable();
+    buffer->len = 0;
+    rt_hw_interrupt_enable(level);
+}
+
+/**
+ * Record writer thread entry, writes the full buffers and flushes the active buffer periodically.
+ * @param params
+ */
+static void record_thread_entry(void *params)
+{
+    while (1)
+    {
+        rt_err_t rst = rt_sem_take(&record_sem, rt_tick_from_millisecond(TASK_MSG_RECORD_FLUSH_MS));
+        struct record_buffer *buffer = RT_NULL;
+
+        rt_base_t level = rt_hw_interrupt_disable();
+        if (rst == RT_EOK)
+        {
+            buffer = record_full;
+        }
+        else if (record_active->len > 0 && record_full == RT_NULL)
+        {
+            //flush the partial buffer when the bus is quiet
+            buffer = record_active;
+            record_full = buffer;
+            record_active = (buffer == &record_buffers[0]) ? &record_buffers[1] : &record_buffers[0];
+        }
+        rt_hw_interrupt_enable(level);
+
+        if (buffer)
+        {
+            record_write(buffer);
+            level = rt_hw_interrupt_disable();
+            record_full = RT_NULL;
+            rt_hw_interrupt_enable(level);
+        }
+
+        if (record_exit)
+        {
+            record_write(record_active);
+            close(record_fd);
+            record_fd = -1;
+            record_thread = RT_NULL;
+            record_exit = RT_FALSE;
+            return;
+        }
+    }
+}
+
+/**
+ * Append a published message to the active buffer, called by the bus on publish.
+ * The space is reserved with the interrupts disabled and the message is copied after.
+ *
+ * @param msg_name: message name
+ * @param msg_obj: message object
+ * @param msg_size: message size
+ */
+void task_msg_record_capture(enum task_msg_name msg_name, const void *msg_obj, rt_size_t msg_size)
+{
+    if (!record_running)
+        return;
+
+    struct task_msg_record_header header;
+    rt_size_t len = sizeof(header) + (msg_obj ? msg_size : 0);
+    header.tick = rt_tick_get();
+    header.msg_name = (rt_uint16_t) msg_name;
+    header.reserved = 0;
+    header.msg_size = msg_obj ? msg_size : 0;
+
+    rt_bool_t wakeup = RT_FALSE;
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (record_active->len + len > TASK_MSG_RECORD_BUFFER_SIZE)
+    {
+        if (record_full == RT_NULL && len <= TASK_MSG_RECORD_BUFFER_SIZE)
+        {
+            record_full = record_active;
+            record_active = (record_full == &record_buffers[0]) ? &record_buffers[1] : &record_buffers[0];
+            wakeup = RT_TRUE;
+        }
+        else
+        {
+            //the writer can not keep up, or the message is too large
+            record_stats.dropped++;
+            rt_hw_interrupt_enable(level);
+            return;
+        }
+    }
+    struct record_buffer *buffer = record_active;
+    rt_uint8_t *data = &buffer->data[buffer->len];
+    buffer->len += len;
+    buffer->writers++;
+    record_stats.recorded++;
+    record_stats.bytes += len;
+    rt_hw_interrupt_enable(level);
+    if (wakeup)
+    {
+        rt_sem_release(&record_sem);
+    }
+
+    rt_memcpy(data, &header, sizeof(header));
+    if (header.msg_size > 0)
+    {
+        rt_memcpy(data + sizeof(header), msg_obj, header.msg_size);
+    }
+    level = rt_hw_interrupt_disable();
+    buffer->writers--;
+    rt_hw_interrupt_enable(level);
+}
+
+/**
+ * Start capturing every published message to a file.
+ * @param path: record file path
+ * @return error code
+ */
+rt_err_t task_msg_record_start(const char *path)
+{
+    record_init();
+    if (record_running || record_thread)
+        return -RT_EBUSY;
+
+    record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0);
+    if (record_fd < 0)
+    {
+        LOG_E("open record file %s failed!", path);
+        return -RT_EIO;
+    }
+    struct task_msg_record_file_header file_header = { TASK_MSG_RECORD_MAGIC, TASK_MSG_RECORD_VERSION,
+            RT_TICK_PER_SECOND };
+    write(record_fd, &file_header, sizeof(file_header));
+
+    record_buffers[0].len = 0;
+    record_buffers[0].writers = 0;
+    record_buffers[1].len = 0;
+    record_buffers[1].writers = 0;
+    record_active = &record_buffers[0];
+    record_full = RT_NULL;
+    rt_memset(&record_stats, 0, sizeof(record_stats));
+
+    record_thread = rt_thread_create("msg_rec", record_thread_entry, RT_NULL, TASK_MSG_RECORD_THREAD_STACK_SIZE,
+            TASK_MSG_RECORD_THREAD_PRIORITY, 20);
+    if (record_thread == RT_NULL)
+    {
+        close(record_fd);
+        record_fd = -1;
+        return -RT_ENOMEM;
+    }
+    record_running = RT_TRUE;
+    rt_thread_startup(record_thread);
+
+    return RT_EOK;
+}
+
+/**
+ * Stop capturing, the buffered records are written and the file is closed by the writer thread.
+ */
+void task_msg_record_stop(void)
+{
+    if (!record_running)
+        return;
+
+    record_running = RT_FALSE;
+    record_exit = RT_TRUE;
+    rt_sem_release(&record_sem);
+}
+
+/**
+ * Get the capture statistics.
+ * @param stats: output parameter
+ */
+void task_msg_record_stats(struct task_msg_record_stats *stats)
+{
+    *stats = record_stats;
+}
+
+struct replay_params
+{
+    char path[TASK_MSG_REPLAY_PATH_MAX];
+    rt_uint32_t speed_percent;
+    rt_uint32_t loops;
+};
+
+/**
+ * Replay thread entry, republishes the recorded messages.
+ * @param params: replay parameters
+ */
+static void replay_thread_entry(void *params)
+{
+    struct replay_params *replay = (struct replay_params *) params;
+    struct task_msg_record_file_header file_header;
+    struct task_msg_record_header header;
+    rt_uint8_t *payload = RT_NULL;
+    rt_size_t payload_size = 0;
+    rt_uint32_t count = 0, failed = 0;
+    rt_uint64_t bytes = 0;
+    //the ticks from when a message is due by the recorded timestamps to when its publish returns
+    rt_uint32_t latency_min = 0, latency_max = 0;
+    rt_uint64_t latency_sum = 0;
+
+    int fd = open(replay->path, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        LOG_E("open record file %s failed!", replay->path);
+        goto EXIT;
+    }
+    if (read(fd, &file_header, sizeof(file_header)) != sizeof(file_header)
+            || file_header.magic != TASK_MSG_RECORD_MAGIC || file_header.version != TASK_MSG_RECORD_VERSION)
+    {
+        LOG_E("%s is not a task msg record file!", replay->path);
+        goto EXIT;
+    }
+
+    rt_tick_t start = rt_tick_get();
+    for (rt_uint32_t loop = 0; replay_running && (replay->loops == 0 || loop < replay->loops); loop++)
+    {
+        rt_bool_t first = RT_TRUE;
+        rt_uint32_t first_tick = 0;
+        rt_tick_t loop_start = rt_tick_get();
+
+        lseek(fd, sizeof(file_header), SEEK_SET);
+        while (replay_running && read(fd, &header, sizeof(header)) == sizeof(header))
+        {
+            if (header.msg_name >= TASK_MSG_COUNT)
+            {
+                LOG_E("invalid record, msg_name:%d", header.msg_name);
+                goto EXIT;
+            }
+            if (header.msg_size > payload_size)
+            {
+                rt_uint8_t *buffer = rt_realloc(payload, header.msg_size);
+                if (buffer == RT_NULL)
+                {
+                    LOG_E("there is no memory available!");
+                    goto EXIT;
+                }
+                payload = buffer;
+                payload_size = header.msg_size;
+            }
+            if (header.msg_size > 0 && read(fd, payload, header.msg_size) != header.msg_size)
+                break;
+
+            if (first)
+            {
+                first = RT_FALSE;
+                first_tick = header.tick;
+            }
+            rt_tick_t due = rt_tick_get();
+            if (replay->speed_percent > 0)
+            {
+                //keep the original message intervals, scaled by the speed
+                rt_uint64_t offset = (rt_uint64_t) (header.tick - first_tick) * RT_TICK_PER_SECOND * 100
+                        / file_header.tick_per_second / replay->speed_percent;
+                due = loop_start + (rt_tick_t) offset;
+                rt_int32_t delay = (rt_int32_t) (due - rt_tick_get());
+                if (delay > 0)
+                {
+                    rt_thread_delay(delay);
+                }
+            }
+
+            if (task_msg_publish_obj((enum task_msg_name) header.msg_name, header.msg_size ? payload : RT_NULL,
+                    header.msg_size) == RT_EOK)
+            {
+                rt_uint32_t latency = rt_tick_get() - due;
+                if (count == 0 || latency < latency_min)
+                    latency_min = latency;
+                if (latency > latency_max)
+                    latency_max = latency;
+                latency_sum += latency;
+                count++;
+                bytes += header.msg_size;
+            }
+            else
+            {
+                failed++;
+            }
+        }
+    }
+
+    rt_tick_t ticks = rt_tick_get() - start;
+    rt_uint32_t ms = ticks * 1000 / RT_TICK_PER_SECOND;
+    LOG_I("replay %s: %d msgs, %d failed, %d bytes, %d ms, %d msgs/s", replay->path, count, failed,
+            (rt_uint32_t ) bytes, ms, ms ? (rt_uint32_t) ((rt_uint64_t) count * 1000 / ms) : count);
+    LOG_I("replay %s: latency(ticks) min %d avg %d max %d", replay->path, latency_min,
+            count ? (rt_uint32_t) (latency_sum / count) : 0, latency_max);
+
+    EXIT: if (fd >= 0)
+        close(fd);
+    if (payload)
+        rt_free(payload);
+    rt_free(replay);
+    rt_base_t level = rt_hw_interrupt_disable();
+    replay_running = RT_FALSE;
+    replay_busy = RT_FALSE;
+    rt_hw_interrupt_enable(level);
+}
+
+/**
+ * Replay a record file through task_msg_publish_obj in a new thread, the count, the throughput and the latency
+ * of the messages(min/avg/max ticks from when a message is due to when it is published) are logged at the end.
+ *
+ * @param path: record file path, shorter than 64 characters
+ * @param speed_percent: 100:original speed, 200:double speed, 0:maximum speed
+ * @param loops: replay count(0:infinite until task_msg_replay_stop)
+ * @return error code
+ */
+rt_err_t task_msg_replay_start(const char *path, rt_uint32_t speed_percent, rt_uint32_t loops)
+{
+    if (path == RT_NULL || rt_strlen(path) >= TASK_MSG_REPLAY_PATH_MAX)
+        return -RT_EINVAL;
+    //test and set in one critical section, so two callers cannot both start a replay
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (replay_busy)
+    {
+        rt_hw_interrupt_enable(level);
+        return -RT_EBUSY;
+    }
+    replay_busy = RT_TRUE;
+    replay_running = RT_TRUE;
+    rt_hw_interrupt_enable(level);
+
+    struct replay_params *replay = rt_calloc(1, sizeof(struct replay_params));
+    if (replay == RT_NULL)
+        goto ERROR;
+    rt_strncpy(replay->path, path, sizeof(replay->path));
+    replay->speed_percent = speed_percent;
+    replay->loops = loops;
+
+    rt_thread_t thread = rt_thread_create("msg_rpl", replay_thread_entry, replay, TASK_MSG_RECORD_THREAD_STACK_SIZE,
+            TASK_MSG_RECORD_THREAD_PRIORITY, 20);
+    if (thread == RT_NULL)
+    {
+        rt_free(replay);
+        goto ERROR;
+    }
+    return rt_thread_startup(thread);
+
+    ERROR: level = rt_hw_interrupt_disable();
+    replay_running = RT_FALSE;
+    replay_busy = RT_FALSE;
+    rt_hw_interrupt_enable(level);
+    return -RT_ENOMEM;
+}
+
+/**
+ * Stop the replay.
+ */
+void task_msg_replay_stop(void)
+{
+    replay_running = RT_FALSE;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+#include <stdlib.h>
+static int task_msg_record(int argc, char **argv)
+{
+    if (argc > 2 && rt_strcmp(argv[1], "start") == 0)
+    {
+        return task_msg_record_start(argv[2]);
+    }
+    else if (argc > 1 && rt_strcmp(argv[1], "stop") == 0)
+    {
+        task_msg_record_stop();
+    }
+    struct task_msg_record_stats stats;
+    task_msg_record_stats(&stats);
+    rt_kprintf("recorded:%d dropped:%d bytes:%d\n", stats.recorded, stats.dropped, stats.bytes);
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(task_msg_record, task msg bus capture: task_msg_record [start <file>|stop]);
+
+static int task_msg_replay(int argc, char **argv)
+{
+    if (argc > 1 && rt_strcmp(argv[1], "stop") == 0)
+    {
+        task_msg_replay_stop();
+        return RT_EOK;
+    }
+    if (argc < 2)
+    {
+        rt_kprintf("usage: task_msg_replay <file> [speed_percent(0:max)] [loops(0:infinite)]\n");
+        return -RT_EINVAL;
+    }
+    return task_msg_replay_start(argv[1], argc > 2 ? atoi(argv[2]) : 100, argc > 3 ? atoi(argv[3]) : 1);
+}
+MSH_CMD_EXPORT(task_msg_replay, task msg bus replay: task_msg_replay <file>|stop [speed_percent] [loops]);
+#endif
+
+#endif /* TASK_MSG_USING_RECORD */
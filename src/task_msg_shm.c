@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+
+#include "task_msg_bus.h"
+#include "task_msg_shm.h"
+
+#ifdef TASK_MSG_USING_SHM_BRIDGE
+
+#define DBG_TAG "task.msg.shm"
+#define DBG_LVL DBG_INFO
+#include <rtdbg.h>
+
+#ifndef TASK_MSG_SHM_THREAD_STACK_SIZE
+#define TASK_MSG_SHM_THREAD_STACK_SIZE 512
+#endif
+#ifndef TASK_MSG_SHM_THREAD_PRIORITY
+#define TASK_MSG_SHM_THREAD_PRIORITY 6
+#endif
+#ifndef TASK_MSG_SHM_POLL_MS
+#define TASK_MSG_SHM_POLL_MS 10     /* the receiver also polls in case a doorbell is lost */
+#endif
+/* cache maintenance of the shared memory, required when it is cacheable and not coherent */
+#ifndef TASK_MSG_SHM_CACHE_FLUSH
+#define TASK_MSG_SHM_CACHE_FLUSH(addr, size)
+#endif
+#ifndef TASK_MSG_SHM_CACHE_INVALIDATE
+#define TASK_MSG_SHM_CACHE_INVALIDATE(addr, size)
+#endif
+#ifndef TASK_MSG_SHM_BARRIER
+#if defined(__GNUC__)
+#define TASK_MSG_SHM_BARRIER() __sync_synchronize()
+#else
+#define TASK_MSG_SHM_BARRIER()
+#endif
+#endif
+
+#define SHM_RECORD_WRAP     0xFFFF
+#define SHM_RECORD_SIZE     sizeof(struct task_msg_shm_record)
+
+static struct task_msg_shm_ring *tx_ring = RT_NULL;
+static struct task_msg_shm_ring *rx_ring = RT_NULL;
+static void (*shm_doorbell)(void) = RT_NULL;
+static struct rt_mutex tx_lock;
+static struct rt_semaphore rx_sem;
+static struct task_msg_shm_stats shm_stats;
+
+/**
+ * Initialize a ring in the shared memory.
+ */
+static struct task_msg_shm_ring *ring_init(rt_uint8_t *addr, rt_size_t size, rt_bool_t master)
+{
+    struct task_msg_shm_ring *ring = (struct task_msg_shm_ring *) addr;
+    rt_uint32_t data_size = 1;
+    while (data_size * 2 <= size - sizeof(struct task_msg_shm_ring))
+    {
+        data_size *= 2;
+    }
+    if (master)
+    {
+        ring->head = 0;
+        ring->tail = 0;
+        ring->size = data_size;
+        TASK_MSG_SHM_BARRIER();
+        ring->magic = TASK_MSG_SHM_MAGIC;
+        TASK_MSG_SHM_CACHE_FLUSH(ring, sizeof(struct task_msg_shm_ring));
+    }
+    return ring;
+}
+
+/**
+ * Write a record into the ring, the payload is copied once into the shared memory.
+ * @return RT_TRUE if written, RT_FALSE if there is no space
+ */
+static rt_bool_t ring_write(struct task_msg_shm_ring *ring, enum task_msg_name msg_name, const void *msg_obj,
+        rt_uint32_t msg_size)
+{
+    TASK_MSG_SHM_CACHE_INVALIDATE(ring, sizeof(struct task_msg_shm_ring));
+    if (ring->magic != TASK_MSG_SHM_MAGIC)
+        return RT_FALSE;
+
+    rt_uint32_t len = RT_ALIGN(SHM_RECORD_SIZE + msg_size, 4);
+    rt_uint32_t head = ring->head;
+    rt_uint32_t used = head - ring->tail;
+    rt_uint32_t offset = head & (ring->size - 1);
+    rt_uint32_t contiguous = ring->size - offset;
+    rt_uint32_t need = (contiguous < len) ? contiguous + len : len;
+    if (len > ring->size / 2 || need > ring->size - used)
+        return RT_FALSE;
+
+    if (contiguous < len)
+    {
+        //the record never wraps, skip to the beginning of the ring
+        if (contiguous >= SHM_RECORD_SIZE)
+        {
+            struct task_msg_shm_record *wrap = (struct task_msg_shm_record *) &ring->data[offset];
+            wrap->msg_name = SHM_RECORD_WRAP;
+            TASK_MSG_SHM_CACHE_FLUSH(wrap, SHM_RECORD_SIZE);
+        }
+        head += contiguous;
+        offset = 0;
+    }
+
+    struct task_msg_shm_record *record = (struct task_msg_shm_record *) &ring->data[offset];
+    record->msg_name = (rt_uint16_t) msg_name;
+    record->reserved = 0;
+    record->msg_size = msg_size;
+    if (msg_size > 0)
+    {
+        rt_memcpy(&ring->data[offset + SHM_RECORD_SIZE], msg_obj, msg_size);
+    }
+    TASK_MSG_SHM_CACHE_FLUSH(record, len);
+    TASK_MSG_SHM_BARRIER();
+    ring->head = head + len;
+    TASK_MSG_SHM_CACHE_FLUSH(&ring->head, sizeof(ring->head));
+
+    return RT_TRUE;
+}
+
+/**
+ * Publish all records of the ring, the payload is copied straight into the bus-owned message storage.
+ *
+ * @param ring: ring
+ * @param stats: the rx counters to update
+ */
+static void ring_read(struct task_msg_shm_ring *ring, struct task_msg_shm_stats *stats)
+{
+    TASK_MSG_SHM_CACHE_INVALIDATE(ring, sizeof(struct task_msg_shm_ring));
+    if (ring->magic != TASK_MSG_SHM_MAGIC)
+        return;
+
+    rt_uint32_t tail = ring->tail;
+    rt_uint32_t head = ring->head;
+    TASK_MSG_SHM_BARRIER();
+    while (tail != head)
+    {
+        rt_uint32_t offset = tail & (ring->size - 1);
+        rt_uint32_t contiguous = ring->size - offset;
+        struct task_msg_shm_record *record = (struct task_msg_shm_record *) &ring->data[offset];
+        if (contiguous >= SHM_RECORD_SIZE)
+        {
+            TASK_MSG_SHM_CACHE_INVALIDATE(record, SHM_RECORD_SIZE);
+        }
+        //a corrupted record must not make the copy or the tail run past the written data
+        rt_bool_t wrap = (contiguous < SHM_RECORD_SIZE || record->msg_name == SHM_RECORD_WRAP);
+        rt_uint32_t msg_size = wrap ? 0 : record->msg_size;
+        rt_uint32_t len = wrap ? contiguous : RT_ALIGN(SHM_RECORD_SIZE + msg_size, 4);
+        if ((!wrap && msg_size > contiguous - SHM_RECORD_SIZE) || len > head - tail)
+        {
+            LOG_E("bad shm record(size %d), drop the rest of the ring!", msg_size);
+            stats->rx_dropped++;
+            tail = head;
+            break;
+        }
+        if (wrap)
+        {
+            tail += len;
+            continue;
+        }
+
+        task_msg_args_t args = RT_NULL;
+        if (record->msg_name < TASK_MSG_COUNT)
+        {
+            args = task_msg_args_alloc((enum task_msg_name) record->msg_name, msg_size);
+        }
+        if (args)
+        {
+            if (msg_size > 0)
+            {
+                TASK_MSG_SHM_CACHE_INVALIDATE(&ring->data[offset + SHM_RECORD_SIZE], msg_size);
+                rt_memcpy(args->msg_obj, &ring->data[offset + SHM_RECORD_SIZE], msg_size);
+            }
+            task_msg_publish_args(args);
+            stats->rx_count++;
+        }
+        else
+        {
+            stats->rx_dropped++;
+        }
+        tail += len;
+    }
+    TASK_MSG_SHM_BARRIER();
+    ring->tail = tail;
+    TASK_MSG_SHM_CACHE_FLUSH(&ring->tail, sizeof(ring->tail));
+}
+
+/**
+ * Forward an exported message to the remote bus.
+ * @param args: message reference
+ */
+static void shm_export_callback(task_msg_args_t args)
+{
+    rt_mutex_take(&tx_lock, RT_WAITING_FOREVER);
+    rt_bool_t written = ring_write(tx_ring, args->msg_name, args->msg_obj, args->msg_obj ? args->msg_size : 0);
+    if (written)
+        shm_stats.tx_count++;
+    else
+        shm_stats.tx_dropped++;
+    rt_mutex_release(&tx_lock);
+
+    if (written && shm_doorbell)
+    {
+        shm_doorbell();
+    }
+}
+
+/**
+ * Shared memory receiver thread entry.
+ * @param params
+ */
+static void shm_rx_thread_entry(void *params)
+{
+    while (1)
+    {
+        rt_sem_take(&rx_sem, rt_tick_from_millisecond(TASK_MSG_SHM_POLL_MS));
+        ring_read(rx_ring, &shm_stats);
+    }
+}
+
+/**
+ * Initialize the shared memory bridge, the region is split into two rings, one for each direction.
+ *
+ * @param shm: shared memory region, at the same place for both sides
+ * @param shm_size: shared memory size
+ * @param master: RT_TRUE on the side which initializes the rings, RT_FALSE on the other side
+ * @param doorbell: function to notify the remote side(such as raise an IPI), RT_NULL:the remote side polls
+ * @return error code
+ */
+rt_err_t task_msg_shm_bridge_init(void *shm, rt_size_t shm_size, rt_bool_t master, void (*doorbell)(void))
+{
+    rt_size_t half = RT_ALIGN_DOWN(shm_size / 2, TASK_MSG_SHM_CACHE_LINE);
+    if (shm == RT_NULL || ((rt_ubase_t) shm % TASK_MSG_SHM_CACHE_LINE) != 0
+            || half < sizeof(struct task_msg_shm_ring) + 64)
+        return -RT_EINVAL;
+    if (tx_ring)
+        return -RT_EBUSY;
+
+    struct task_msg_shm_ring *ring_a = ring_init((rt_uint8_t *) shm, half, master);
+    struct task_msg_shm_ring *ring_b = ring_init((rt_uint8_t *) shm + half, half, master);
+    tx_ring = master ? ring_a : ring_b;
+    rx_ring = master ? ring_b : ring_a;
+    shm_doorbell = doorbell;
+    rt_mutex_init(&tx_lock, "shm_tx", RT_IPC_FLAG_FIFO);
+    rt_sem_init(&rx_sem, "shm_rx", 0, RT_IPC_FLAG_FIFO);
+
+    rt_thread_t thread = rt_thread_create("msg_shm", shm_rx_thread_entry, RT_NULL, TASK_MSG_SHM_THREAD_STACK_SIZE,
+            TASK_MSG_SHM_THREAD_PRIORITY, 20);
+    if (thread == RT_NULL)
+    {
+        LOG_E("task msg shm bridge initialize failed! msg_shm thread create failed!");
+        return -RT_ENOMEM;
+    }
+    return rt_thread_startup(thread);
+}
+
+/**
+ * Mirror a message name to the remote bus, a message name shall be exported by one side only.
+ *
+ * @param msg_name: message name
+ * @return error code
+ */
+rt_err_t task_msg_shm_bridge_export(enum task_msg_name msg_name)
+{
+    if (tx_ring == RT_NULL || msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
+    return task_msg_subscribe(msg_name, shm_export_callback);
+}
+
+/**
+ * Notify the receiver that the remote side has written records, call it in the doorbell ISR.
+ */
+void task_msg_shm_bridge_doorbell_isr(void)
+{
+    if (rx_ring)
+    {
+        rt_sem_release(&rx_sem);
+    }
+}
+
+/**
+ * Get the bridge statistics.
+ * @param stats: output parameter
+ */
+void task_msg_shm_bridge_stats(struct task_msg_shm_stats *stats)
+{
+    *stats = shm_stats;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+static int task_msg_shm(int argc, char **argv)
+{
+    rt_kprintf("tx:%d tx_dropped:%d rx:%d rx_dropped:%d\n", shm_stats.tx_count, shm_stats.tx_dropped,
+            shm_stats.rx_count, shm_stats.rx_dropped);
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(task_msg_shm, task msg bus shared memory bridge statistics);
+
+#include <stdlib.h>
+
+#ifndef TASK_MSG_SHM_BENCH_SIZE
+#define TASK_MSG_SHM_BENCH_SIZE 8192    /* the ring of the loopback benchmark */
+#endif
+
+static struct task_msg_shm_ring *bench_ring = RT_NULL;
+static struct task_msg_shm_stats bench_stats;
+static struct rt_semaphore bench_rx_sem;    /* the doorbell of the simulated remote side */
+static struct rt_semaphore bench_ack_sem;   /* a message has reached the bus callback */
+static struct rt_semaphore bench_exit_sem;
+static volatile rt_bool_t bench_running = RT_FALSE;
+static volatile rt_uint32_t bench_received = 0;
+
+/**
+ * The receiver of the simulated remote side, reads the ring as the msg_shm thread does.
+ * @param params
+ */
+static void shm_bench_rx_entry(void *params)
+{
+    while (bench_running)
+    {
+        rt_sem_take(&bench_rx_sem, rt_tick_from_millisecond(TASK_MSG_SHM_POLL_MS));
+        ring_read(bench_ring, &bench_stats);
+    }
+    rt_sem_release(&bench_exit_sem);
+}
+
+static void shm_bench_callback(task_msg_args_t args)
+{
+    bench_received++;
+    rt_sem_release(&bench_ack_sem);
+}
+
+/**
+ * Write count records of msg_size bytes into the ring, the doorbell is rung after each one.
+ * @param ping: wait until every message reaches the bus callback before writing the next one
+ * @return elapsed ticks
+ */
+static rt_tick_t shm_bench_run(enum task_msg_name msg_name, rt_uint8_t *buffer, rt_uint32_t msg_size,
+        rt_uint32_t count, rt_bool_t ping)
+{
+    bench_received = 0;
+    rt_memset(&bench_stats, 0, sizeof(bench_stats));
+    while (rt_sem_trytake(&bench_ack_sem) == RT_EOK)
+    {
+    }
+
+    rt_tick_t start = rt_tick_get();
+    for (rt_uint32_t i = 0; i < count; i++)
+    {
+        while (!ring_write(bench_ring, msg_name, buffer, msg_size))
+        {
+            //the ring is full, let the receiver drain it
+            rt_sem_release(&bench_rx_sem);
+            rt_thread_delay(1);
+        }
+        rt_sem_release(&bench_rx_sem);
+        if (ping)
+        {
+            rt_sem_take(&bench_ack_sem, RT_TICK_PER_SECOND);
+        }
+    }
+    //a message dropped by the receiver never reaches the callback
+    while (bench_received + bench_stats.rx_dropped < count && rt_tick_get() - start < 10 * RT_TICK_PER_SECOND)
+    {
+        rt_thread_mdelay(1);
+    }
+    return rt_tick_get() - start;
+}
+
+/**
+ * Loopback benchmark of the shared memory ring in one image: a thread at the priority of the msg_shm
+ * thread plays the remote side and publishes the records on the local bus, the throughput and the latency
+ * (from the record being written to the bus callback, one message at a time) are reported per message size.
+ * It uses a ring of its own, so it can run beside the bridge, msg_name shall not be exported.
+ * usage: task_msg_shm_bench <msg_name> [count]
+ */
+static int task_msg_shm_bench(int argc, char **argv)
+{
+    static const rt_uint32_t sizes[] = { 16, 64, 256, 1024 };
+    if (argc < 2)
+    {
+        rt_kprintf("usage: task_msg_shm_bench <msg_name> [count]\n");
+        return -RT_EINVAL;
+    }
+    enum task_msg_name msg_name = (enum task_msg_name) atoi(argv[1]);
+    rt_uint32_t count = argc > 2 ? atoi(argv[2]) : 1000;
+    if (msg_name >= TASK_MSG_COUNT || count == 0)
+        return -RT_EINVAL;
+    if (bench_running)
+        return -RT_EBUSY;
+
+    rt_uint8_t *region = rt_malloc(TASK_MSG_SHM_BENCH_SIZE + TASK_MSG_SHM_CACHE_LINE);
+    rt_uint8_t *buffer = rt_malloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+    if (region == RT_NULL || buffer == RT_NULL)
+    {
+        rt_free(region);
+        rt_free(buffer);
+        return -RT_ENOMEM;
+    }
+    rt_memset(buffer, 0x5A, sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+    bench_ring = ring_init((rt_uint8_t *) RT_ALIGN((rt_ubase_t) region, TASK_MSG_SHM_CACHE_LINE),
+            TASK_MSG_SHM_BENCH_SIZE, RT_TRUE);
+    rt_sem_init(&bench_rx_sem, "shm_brx", 0, RT_IPC_FLAG_FIFO);
+    rt_sem_init(&bench_ack_sem, "shm_back", 0, RT_IPC_FLAG_FIFO);
+    rt_sem_init(&bench_exit_sem, "shm_bext", 0, RT_IPC_FLAG_FIFO);
+    bench_running = RT_TRUE;
+    rt_thread_t thread = rt_thread_create("shm_bnch", shm_bench_rx_entry, RT_NULL, TASK_MSG_SHM_THREAD_STACK_SIZE,
+            TASK_MSG_SHM_THREAD_PRIORITY, 20);
+    if (thread == RT_NULL)
+    {
+        bench_running = RT_FALSE;
+    }
+    else
+    {
+        rt_thread_startup(thread);
+        task_msg_subscribe(msg_name, shm_bench_callback);
+        rt_kprintf(" size   msgs/s     KB/s  latency(us)  dropped\n");
+        for (rt_size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            if (RT_ALIGN(SHM_RECORD_SIZE + sizes[i], 4) > bench_ring->size / 2)
+                break;
+            rt_tick_t ticks = shm_bench_run(msg_name, buffer, sizes[i], count, RT_FALSE);
+            rt_uint32_t dropped = bench_stats.rx_dropped;
+            rt_uint64_t us = (rt_uint64_t) ticks * 1000000 / RT_TICK_PER_SECOND;
+            rt_uint32_t rate = us ? (rt_uint32_t) ((rt_uint64_t) bench_received * 1000000 / us) : 0;
+            rt_tick_t ping_ticks = shm_bench_run(msg_name, buffer, sizes[i], count, RT_TRUE);
+            rt_uint32_t latency = (rt_uint32_t) ((rt_uint64_t) ping_ticks * 1000000 / RT_TICK_PER_SECOND / count);
+            rt_kprintf("%5d %8d %8d %12d %8d\n", sizes[i], rate, (rt_uint32_t) ((rt_uint64_t) rate * sizes[i] / 1024),
+                    latency, dropped + bench_stats.rx_dropped);
+        }
+        task_msg_unsubscribe(msg_name, shm_bench_callback);
+        bench_running = RT_FALSE;
+        rt_sem_release(&bench_rx_sem);
+        rt_sem_take(&bench_exit_sem, RT_WAITING_FOREVER);
+    }
+
+    rt_sem_detach(&bench_rx_sem);
+    rt_sem_detach(&bench_ack_sem);
+    rt_sem_detach(&bench_exit_sem);
+    rt_free(region);
+    rt_free(buffer);
+    bench_ring = RT_NULL;
+    return thread ? RT_EOK : -RT_ENOMEM;
+}
+MSH_CMD_EXPORT(task_msg_shm_bench, task msg bus shared memory ring loopback benchmark: task_msg_shm_bench <msg_name> [count]);
+#endif
+
+#endif /* TASK_MSG_USING_SHM_BRIDGE */
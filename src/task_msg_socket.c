@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+
+#include "task_msg_bus.h"
+#include "task_msg_socket.h"
+
+#ifdef TASK_MSG_USING_SOCKET_BRIDGE
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#define DBG_TAG "task.msg.socket"
+#define DBG_LVL DBG_INFO
+#include <rtdbg.h>
+
+#ifndef TASK_MSG_SOCKET_TX_BUFFER_SIZE
+#define TASK_MSG_SOCKET_TX_BUFFER_SIZE 1024
+#endif
+#ifndef TASK_MSG_SOCKET_RX_BUFFER_SIZE
+#define TASK_MSG_SOCKET_RX_BUFFER_SIZE 1024
+#endif
+#ifndef TASK_MSG_SOCKET_LATENCY_MS
+#define TASK_MSG_SOCKET_LATENCY_MS 5    /* the longest time a frame waits in the tx buffer */
+#endif
+#ifndef TASK_MSG_SOCKET_THREAD_STACK_SIZE
+#define TASK_MSG_SOCKET_THREAD_STACK_SIZE 1024
+#endif
+#ifndef TASK_MSG_SOCKET_THREAD_PRIORITY
+#define TASK_MSG_SOCKET_THREAD_PRIORITY 10
+#endif
+
+struct tx_buffer
+{
+    rt_uint8_t data[TASK_MSG_SOCKET_TX_BUFFER_SIZE];
+    rt_size_t len;
+};
+
+static struct tx_buffer tx_buffers[2];
+static struct tx_buffer *tx_active = &tx_buffers[0];
+static struct tx_buffer *tx_full = RT_NULL;  /* handed over to the tx thread */
+static struct rt_mutex tx_lock;
+static struct rt_semaphore tx_sem;
+static rt_uint8_t rx_buffer[TASK_MSG_SOCKET_RX_BUFFER_SIZE];
+static volatile int client_fd = -1;
+static rt_bool_t socket_init_tag = RT_FALSE;    /* set once both threads run */
+static rt_bool_t socket_starting = RT_FALSE;
+static struct task_msg_socket_stats socket_stats;
+
+/**
+ * Write the frame header in little-endian whatever the byte order of the device is.
+ *
+ * @param buffer: where the header is written
+ * @param msg_name: message name
+ * @param msg_size: size of the message object
+ */
+static void socket_frame_encode(rt_uint8_t *buffer, rt_uint16_t msg_name, rt_uint16_t msg_size)
+{
+    buffer[0] = (rt_uint8_t) msg_name;
+    buffer[1] = (rt_uint8_t) (msg_name >> 8);
+    buffer[2] = (rt_uint8_t) msg_size;
+    buffer[3] = (rt_uint8_t) (msg_size >> 8);
+}
+
+static void socket_frame_decode(const rt_uint8_t *buffer, struct task_msg_socket_frame *frame)
+{
+    frame->msg_name = (rt_uint16_t) (buffer[0] | (buffer[1] << 8));
+    frame->msg_size = (rt_uint16_t) (buffer[2] | (buffer[3] << 8));
+}
+
+/**
+ * Append an exported message to the tx buffer, the tx thread writes it in a batch.
+ * @param args: message reference
+ */
+static void socket_export_callback(task_msg_args_t args)
+{
+    rt_size_t msg_size = args->msg_obj ? args->msg_size : 0;
+    rt_size_t len = sizeof(struct task_msg_socket_frame) + msg_size;
+
+    //the client already has the messages it sent
+    if (client_fd < 0 || args->origin == TASK_MSG_ORIGIN_SOCKET)
+        return;
+
+    rt_mutex_take(&tx_lock, RT_WAITING_FOREVER);
+    if (tx_active->len + len > TASK_MSG_SOCKET_TX_BUFFER_SIZE && tx_full == RT_NULL)
+    {
+        //hand the full buffer to the tx thread and keep filling the other one
+        tx_full = tx_active;
+        tx_active = (tx_active == &tx_buffers[0]) ? &tx_buffers[1] : &tx_buffers[0];
+        rt_sem_release(&tx_sem);
+    }
+    if (msg_size > 0xFFFF || tx_active->len + len > TASK_MSG_SOCKET_TX_BUFFER_SIZE)
+    {
+        socket_stats.tx_dropped++;
+        rt_mutex_release(&tx_lock);
+        return;
+    }
+    socket_frame_encode(&tx_active->data[tx_active->len], (rt_uint16_t) args->msg_name, (rt_uint16_t) msg_size);
+    if (msg_size > 0)
+    {
+        rt_memcpy(&tx_active->data[tx_active->len + sizeof(struct task_msg_socket_frame)], args->msg_obj, msg_size);
+    }
+    tx_active->len += len;
+    socket_stats.tx_count++;
+    //wake the tx thread once, when the buffer crosses the half
+    rt_bool_t wakeup = (tx_active->len >= TASK_MSG_SOCKET_TX_BUFFER_SIZE / 2
+            && tx_active->len - len < TASK_MSG_SOCKET_TX_BUFFER_SIZE / 2);
+    rt_mutex_release(&tx_lock);
+
+    if (wakeup)
+    {
+        rt_sem_release(&tx_sem);
+    }
+}
+
+/**
+ * Tx thread entry, writes the batched frames when half of the buffer is used
+ * or when the latency cap expires.
+ * @param params
+ */
+static void socket_tx_thread_entry(void *params)
+{
+    while (1)
+    {
+        rt_sem_take(&tx_sem, rt_tick_from_millisecond(TASK_MSG_SOCKET_LATENCY_MS));
+
+        rt_mutex_take(&tx_lock, RT_WAITING_FOREVER);
+        if (tx_full == RT_NULL)
+        {
+            if (tx_active->len == 0)
+            {
+                rt_mutex_release(&tx_lock);
+                continue;
+            }
+            tx_full = tx_active;
+            tx_active = (tx_active == &tx_buffers[0]) ? &tx_buffers[1] : &tx_buffers[0];
+        }
+        struct tx_buffer *buffer = tx_full;
+        rt_mutex_release(&tx_lock);
+
+        int fd = client_fd;
+        rt_size_t sent = 0;
+        while (fd >= 0 && sent < buffer->len)
+        {
+            int rst = send(fd, &buffer->data[sent], buffer->len - sent, 0);
+            if (rst <= 0)
+                break;
+            sent += rst;
+        }
+        socket_stats.tx_writes++;
+
+        rt_mutex_take(&tx_lock, RT_WAITING_FOREVER);
+        buffer->len = 0;
+        tx_full = RT_NULL;
+        rt_mutex_release(&tx_lock);
+    }
+}
+
+/**
+ * Publish the complete frames of the rx buffer, the message objects are copied
+ * straight from the rx buffer into the bus-owned storage.
+ *
+ * @param len: received length
+ * @return the length of the incomplete frame left in the rx buffer, <0:bad frame
+ */
+static int socket_rx_parse(rt_size_t len)
+{
+    struct task_msg_socket_frame frame;
+    rt_size_t offset = 0;
+    while (len - offset >= sizeof(frame))
+    {
+        socket_frame_decode(&rx_buffer[offset], &frame);
+        if (sizeof(frame) + frame.msg_size > TASK_MSG_SOCKET_RX_BUFFER_SIZE)
+            return -1;
+        if (len - offset < sizeof(frame) + frame.msg_size)
+            break;
+
+        task_msg_args_t args = RT_NULL;
+        if (frame.msg_name < TASK_MSG_COUNT)
+        {
+            args = task_msg_args_alloc((enum task_msg_name) frame.msg_name, frame.msg_size);
+        }
+        if (args)
+        {
+            if (frame.msg_size > 0)
+            {
+                rt_memcpy(args->msg_obj, &rx_buffer[offset + sizeof(frame)], frame.msg_size);
+            }
+            args->origin = TASK_MSG_ORIGIN_SOCKET;
+        }
+        if (args && task_msg_publish_args(args) == RT_EOK)
+        {
+            socket_stats.rx_count++;
+        }
+        else
+        {
+            socket_stats.rx_dropped++;
+        }
+        offset += sizeof(frame) + frame.msg_size;
+    }
+
+    if (offset > 0 && offset < len)
+    {
+        rt_memmove(rx_buffer, &rx_buffer[offset], len - offset);
+    }
+    return len - offset;
+}
+
+/**
+ * Server thread entry, accepts one client at a time and publishes its frames.
+ * @param params: listen port
+ */
+static void socket_server_thread_entry(void *params)
+{
+    struct sockaddr_in addr;
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0)
+    {
+        LOG_E("socket create failed!");
+        return;
+    }
+    rt_memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((rt_uint16_t) (rt_ubase_t) params);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(server_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(server_fd, 1) < 0)
+    {
+        LOG_E("socket bind/listen port %d failed!", (rt_uint16_t) (rt_ubase_t) params);
+        closesocket(server_fd);
+        return;
+    }
+
+    while (1)
+    {
+        int fd = accept(server_fd, RT_NULL, RT_NULL);
+        if (fd < 0)
+            continue;
+        LOG_I("client connected.");
+        client_fd = fd;
+
+        int left = 0;
+        while (1)
+        {
+            int rst = recv(fd, &rx_buffer[left], TASK_MSG_SOCKET_RX_BUFFER_SIZE - left, 0);
+            if (rst <= 0)
+                break;
+            socket_stats.rx_reads++;
+            left = socket_rx_parse(left + rst);
+            if (left < 0)
+            {
+                LOG_E("bad frame, disconnect the client!");
+                break;
+            }
+        }
+
+        client_fd = -1;
+        closesocket(fd);
+        LOG_I("client disconnected.");
+    }
+}
+
+/**
+ * Start the socket bridge server, one client can connect to it at a time.
+ *
+ * @param port: listen port
+ * @return error code
+ */
+rt_err_t task_msg_socket_bridge_start(rt_uint16_t port)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (socket_init_tag || socket_starting)
+    {
+        rt_hw_interrupt_enable(level);
+        return -RT_EBUSY;
+    }
+    socket_starting = RT_TRUE;
+    rt_hw_interrupt_enable(level);
+
+    rt_thread_t t1 = rt_thread_create("msg_stx", socket_tx_thread_entry, RT_NULL, TASK_MSG_SOCKET_THREAD_STACK_SIZE,
+            TASK_MSG_SOCKET_THREAD_PRIORITY, 20);
+    rt_thread_t t2 = rt_thread_create("msg_srx", socket_server_thread_entry, (void *) (rt_ubase_t) port,
+            TASK_MSG_SOCKET_THREAD_STACK_SIZE, TASK_MSG_SOCKET_THREAD_PRIORITY, 20);
+    if (t1 == RT_NULL || t2 == RT_NULL)
+    {
+        if (t1)
+            rt_thread_delete(t1);
+        if (t2)
+            rt_thread_delete(t2);
+        socket_starting = RT_FALSE;
+        LOG_E("task msg socket bridge start failed! thread create failed!");
+        return -RT_ENOMEM;
+    }
+
+    rt_mutex_init(&tx_lock, "sock_tx", RT_IPC_FLAG_FIFO);
+    rt_sem_init(&tx_sem, "sock_tx", 0, RT_IPC_FLAG_FIFO);
+    rt_thread_startup(t1);
+    rt_thread_startup(t2);
+    socket_init_tag = RT_TRUE;
+    socket_starting = RT_FALSE;
+
+    return RT_EOK;
+}
+
+/**
+ * Forward a message name to the connected client.
+ *
+ * @param msg_name: message name
+ * @return error code
+ */
+rt_err_t task_msg_socket_bridge_export(enum task_msg_name msg_name)
+{
+    if (!socket_init_tag || msg_name >= TASK_MSG_COUNT)
+        return -RT_EINVAL;
+
+    return task_msg_subscribe(msg_name, socket_export_callback);
+}
+
+/**
+ * Get the bridge statistics.
+ * @param stats: output parameter
+ */
+void task_msg_socket_bridge_stats(struct task_msg_socket_stats *stats)
+{
+    *stats = socket_stats;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+#include <stdlib.h>
+static int task_msg_socket(int argc, char **argv)
+{
+    if (argc > 2 && rt_strcmp(argv[1], "start") == 0)
+        return task_msg_socket_bridge_start(atoi(argv[2]));
+    if (argc > 2 && rt_strcmp(argv[1], "export") == 0)
+        return task_msg_socket_bridge_export((enum task_msg_name) atoi(argv[2]));
+
+    rt_kprintf("tx:%d tx_dropped:%d tx_writes:%d rx:%d rx_dropped:%d rx_reads:%d\n", socket_stats.tx_count,
+            socket_stats.tx_dropped, socket_stats.tx_writes, socket_stats.rx_count, socket_stats.rx_dropped,
+            socket_stats.rx_reads);
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(task_msg_socket, task msg bus socket bridge: task_msg_socket [start <port>|export <msg_name>]);
+#endif
+
+#endif /* TASK_MSG_USING_SOCKET_BRIDGE */
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+
+#include "task_msg_bus.h"
+#include "task_msg_stream.h"
+
+#ifdef TASK_MSG_USING_STREAM
+
+#define DBG_TAG "task.msg.stream"
+#define DBG_LVL DBG_INFO
+#include <rtdbg.h>
+
+/**
+ * A pool block holds the stream it belongs to followed by the chunk, so the chunk can find
+ * its stream when the last subscriber releases it. The pool has one block per credit:
+ * a chunk being filled or not yet released by every subscriber holds a credit.
+ */
+struct task_msg_stream
+{
+    enum task_msg_name msg_name;
+    rt_uint32_t id;
+    rt_uint32_t total;
+    rt_uint32_t offset;         /* bytes published */
+    rt_uint16_t chunk_size;
+    rt_uint8_t outstanding;     /* blocks taken from the pool */
+    rt_bool_t closed;           /* the stream is freed when the last block is returned */
+    rt_err_t error;             /* a chunk could not be published, the stream ends with an abort */
+    rt_mp_t pool;
+    void *block;                /* being filled */
+};
+
+static rt_uint32_t stream_id = 0;
+
+static task_msg_chunk_t stream_block_chunk(void *block)
+{
+    return (task_msg_chunk_t) ((task_msg_stream_t *) block + 1);
+}
+
+static void stream_destroy(task_msg_stream_t stream)
+{
+    rt_mp_delete(stream->pool);
+    rt_free(stream);
+}
+
+/**
+ * The obj_free of the chunks: give the block back to the pool, which wakes up
+ * the producer waiting for a credit, the last block of a closed stream frees it.
+ *
+ * @param msg_obj: chunk
+ */
+static void stream_chunk_free(void *msg_obj)
+{
+    void *block = (task_msg_stream_t *) msg_obj - 1;
+    task_msg_stream_t stream = *(task_msg_stream_t *) block;
+
+    //the pool is still needed here, so count the block as returned afterwards
+    rt_mp_free(block);
+    rt_base_t level = rt_hw_interrupt_disable();
+    rt_bool_t destroy = (--stream->outstanding == 0 && stream->closed);
+    rt_hw_interrupt_enable(level);
+    if (destroy)
+    {
+        stream_destroy(stream);
+    }
+}
+
+/**
+ * Take a block from the pool for the next chunk.
+ *
+ * @param stream: stream
+ * @param timeout: the waiting ticks for a credit
+ * @return error code
+ */
+static rt_err_t stream_block_alloc(task_msg_stream_t stream, rt_int32_t timeout)
+{
+    void *block = rt_mp_alloc(stream->pool, timeout);
+    if (block == RT_NULL)
+        return -RT_ETIMEOUT;
+
+    rt_base_t level = rt_hw_interrupt_disable();
+    stream->outstanding++;
+    rt_hw_interrupt_enable(level);
+
+    *(task_msg_stream_t *) block = stream;
+    task_msg_chunk_t chunk = stream_block_chunk(block);
+    chunk->stream_id = stream->id;
+    chunk->offset = stream->offset;
+    chunk->total = stream->total;
+    chunk->len = 0;
+    chunk->flags = 0;
+    stream->block = block;
+
+    return RT_EOK;
+}
+
+/**
+ * Publish the chunk being filled, the bus owns the block afterwards even if failed.
+ *
+ * @param stream: stream
+ * @param flags: TASK_MSG_CHUNK_END or 0
+ * @return error code
+ */
+static rt_err_t stream_chunk_publish(task_msg_stream_t stream, rt_uint16_t flags)
+{
+    task_msg_chunk_t chunk = stream_block_chunk(stream->block);
+    rt_uint16_t len = chunk->len;
+    chunk->flags |= flags;
+    stream->block = RT_NULL;
+
+    task_msg_args_t args = task_msg_args_attach(stream->msg_name, chunk, sizeof(struct task_msg_chunk) + len,
+            stream_chunk_free);
+    if (args == RT_NULL)
+    {
+        stream_chunk_free(chunk);
+        return -RT_ENOMEM;
+    }
+    //the chunk may have been released already when this returns
+    rt_err_t rst = task_msg_publish_args(args);
+    if (rst == RT_EOK)
+    {
+        stream->offset += len;
+    }
+
+    return rst;
+}
+
+/**
+ * Publish a chunk without data which only carries the flags, it is copied by the bus
+ * so it does not need a credit.
+ *
+ * @param stream: stream
+ * @param flags: TASK_MSG_CHUNK_END or TASK_MSG_CHUNK_ABORT
+ * @return error code
+ */
+static rt_err_t stream_mark_publish(task_msg_stream_t stream, rt_uint16_t flags)
+{
+    struct task_msg_chunk chunk;
+    chunk.stream_id = stream->id;
+    chunk.offset = stream->offset;
+    chunk.total = stream->total;
+    chunk.len = 0;
+    chunk.flags = flags;
+
+    return task_msg_publish_obj(stream->msg_name, &chunk, sizeof(chunk));
+}
+
+/**
+ * Mark the stream closed and free it at once if no subscriber holds a chunk of it.
+ * @param stream: stream
+ */
+static void stream_release(task_msg_stream_t stream)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    stream->closed = RT_TRUE;
+    rt_bool_t destroy = (stream->outstanding == 0);
+    rt_hw_interrupt_enable(level);
+    if (destroy)
+    {
+        stream_destroy(stream);
+    }
+}
+
+/**
+ * Open a stream to publish an object larger than a single allocation(e.g. a firmware image or a camera frame)
+ * as a series of chunks on a message name, the subscribers receive the chunks as they are written.
+ * The chunks come from a pool of credits blocks, so the memory used is credits chunks whatever the size
+ * of the object is, and the producer waits when every credit is held by the subscribers.
+ *
+ * @param msg_name: message name, the message object is struct task_msg_chunk
+ * @param chunk_size: the bytes of data in a chunk
+ * @param credits: the chunks the subscribers may hold at a time(2 at least for the producer to fill one
+ *                 while the other is consumed)
+ * @param total: size of the whole object(0:unknown), passed on to the subscribers
+ * @return the stream, RT_NULL if failed
+ */
+task_msg_stream_t task_msg_stream_open(enum task_msg_name msg_name, rt_uint16_t chunk_size, rt_uint8_t credits,
+        rt_uint32_t total)
+{
+    if (msg_name >= TASK_MSG_COUNT || chunk_size == 0 || credits == 0)
+        return RT_NULL;
+
+    task_msg_stream_t stream = rt_calloc(1, sizeof(struct task_msg_stream));
+    if (stream == RT_NULL)
+        return RT_NULL;
+    stream->pool = rt_mp_create("msg_strm", credits,
+            sizeof(task_msg_stream_t) + sizeof(struct task_msg_chunk) + chunk_size);
+    if (stream->pool == RT_NULL)
+    {
+        LOG_E("stream pool create failed! %d chunks of %d bytes", credits, chunk_size);
+        rt_free(stream);
+        return RT_NULL;
+    }
+    stream->msg_name = msg_name;
+    stream->total = total;
+    stream->chunk_size = chunk_size;
+    rt_base_t level = rt_hw_interrupt_disable();
+    stream->id = ++stream_id;
+    rt_hw_interrupt_enable(level);
+
+    return stream;
+}
+
+/**
+ * Copy data into the chunks of the stream, every full chunk is published at once(shall not be used in ISR).
+ *
+ * @param stream: stream
+ * @param buffer: data
+ * @param size: data size
+ * @param timeout_ms: the waiting millisecond for the subscribers to give back credits(-1:waiting forever)
+ * @return the bytes written, less than size if it timed out or a chunk could not be published
+ */
+rt_size_t task_msg_stream_write(task_msg_stream_t stream, const void *buffer, rt_size_t size, rt_int32_t timeout_ms)
+{
+    if (stream == RT_NULL || stream->error != RT_EOK || (buffer == RT_NULL && size > 0))
+        return 0;
+
+    rt_size_t written = 0;
+    rt_int32_t timeout = rt_tick_from_millisecond(timeout_ms);
+    rt_tick_t start = rt_tick_get();
+    while (written < size)
+    {
+        if (stream->block == RT_NULL)
+        {
+            rt_int32_t wait = RT_WAITING_FOREVER;
+            if (timeout >= 0)
+            {
+                rt_tick_t elapsed = rt_tick_get() - start;
+                wait = elapsed < (rt_tick_t) timeout ? (rt_int32_t) (timeout - elapsed) : 0;
+            }
+            if (stream_block_alloc(stream, wait) != RT_EOK)
+                break;
+        }
+
+        task_msg_chunk_t chunk = stream_block_chunk(stream->block);
+        rt_size_t len = stream->chunk_size - chunk->len;
+        if (len > size - written)
+        {
+            len = size - written;
+        }
+        rt_memcpy(chunk->data + chunk->len, (const rt_uint8_t *) buffer + written, len);
+        chunk->len += len;
+        written += len;
+        if (chunk->len == stream->chunk_size)
+        {
+            rt_err_t rst = stream_chunk_publish(stream, 0);
+            if (rst != RT_EOK)
+            {
+                //the data written by the previous calls is lost too, so the stream can only be aborted
+                LOG_E("msg_name[%d] stream %d chunk publish failed(%d)!", stream->msg_name, stream->id, rst);
+                stream->error = rst;
+                written -= len;
+                break;
+            }
+        }
+    }
+
+    return written;
+}
+
+/**
+ * Publish the remaining data with TASK_MSG_CHUNK_END and close the stream, the stream is freed
+ * when the subscribers release its last chunk(shall not be used in ISR).
+ *
+ * @param stream: stream
+ * @return error code, the stream ends with TASK_MSG_CHUNK_ABORT instead if a chunk could not be published
+ */
+rt_err_t task_msg_stream_close(task_msg_stream_t stream)
+{
+    if (stream == RT_NULL)
+        return -RT_EINVAL;
+
+    rt_err_t rst = stream->error;
+    if (rst != RT_EOK)
+    {
+        task_msg_stream_abort(stream);
+        return rst;
+    }
+    if (stream->block)
+        rst = stream_chunk_publish(stream, TASK_MSG_CHUNK_END);
+    else
+        rst = stream_mark_publish(stream, TASK_MSG_CHUNK_END);
+    stream_release(stream);
+
+    return rst;
+}
+
+/**
+ * Drop the data not published yet, publish TASK_MSG_CHUNK_ABORT and close the stream(shall not be used in ISR).
+ *
+ * @param stream: stream
+ * @return error code
+ */
+rt_err_t task_msg_stream_abort(task_msg_stream_t stream)
+{
+    if (stream == RT_NULL)
+        return -RT_EINVAL;
+
+    if (stream->block)
+    {
+        void *block = stream->block;
+        stream->block = RT_NULL;
+        stream_chunk_free(stream_block_chunk(block));
+    }
+    rt_err_t rst = stream_mark_publish(stream, TASK_MSG_CHUNK_ABORT);
+    stream_release(stream);
+
+    return rst;
+}
+
+/**
+ * Get the chunk carried by a stream message.
+ *
+ * @param args: message reference
+ * @return the chunk, RT_NULL if the message object is not a chunk
+ */
+const struct task_msg_chunk *task_msg_chunk_get(task_msg_args_t args)
+{
+    if (args == RT_NULL || args->msg_obj == RT_NULL || args->msg_size < sizeof(struct task_msg_chunk))
+        return RT_NULL;
+
+    const struct task_msg_chunk *chunk = (const struct task_msg_chunk *) args->msg_obj;
+    if (args->msg_size < sizeof(struct task_msg_chunk) + chunk->len)
+        return RT_NULL;
+
+    return chunk;
+}
+
+#endif
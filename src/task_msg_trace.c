@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2006-2020, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2020-03-22     sly_ant      the first version
+ */
+
+#include "task_msg_bus.h"
+#include "task_msg_trace.h"
+
+#ifdef TASK_MSG_USING_TRACE
+
+#if (TASK_MSG_TRACE_RECORDS & (TASK_MSG_TRACE_RECORDS - 1)) != 0
+#error "TASK_MSG_TRACE_RECORDS must be a power of 2"
+#endif
+
+static struct task_msg_trace_record trace_buffer[TASK_MSG_TRACE_RECORDS];
+static rt_uint32_t trace_index = 0;
+static rt_bool_t trace_enable = RT_TRUE;
+static rt_uint32_t trace_stamp_rate = 0;   /* stamps per second when the recording started, 0:not started */
+
+static const char *trace_event_name[TASK_MSG_TRACE_EVENT_COUNT] =
+{
+    "publish", "dispatch", "dispatched", "cb_enter", "cb_exit", "wakeup", "release", "drop", "timer", "expire"
+};
+
+/**
+ * Get the timestamp of a trace record, override it to use a cycle counter.
+ * @return timestamp
+ */
+RT_WEAK rt_uint32_t task_msg_trace_stamp(void)
+{
+    return rt_tick_get();
+}
+
+/**
+ * Get the number of stamps per second, override it together with task_msg_trace_stamp.
+ * @return stamps per second
+ */
+RT_WEAK rt_uint32_t task_msg_trace_stamp_rate(void)
+{
+    return RT_TICK_PER_SECOND;
+}
+
+/**
+ * Write a trace record into the ring buffer(can be used in ISR).
+ *
+ * @param event: trace event
+ * @param msg_name: message name
+ * @param subscriber_id: subscriber id(-1:none)
+ * @param arg: event argument
+ */
+void task_msg_trace_write(rt_uint8_t event, rt_uint8_t msg_name, rt_int16_t subscriber_id, rt_uint16_t arg)
+{
+    if (!trace_enable)
+        return;
+
+    rt_uint16_t in_flight = (rt_uint16_t) task_msg_in_flight();
+    //the record is filled in the same critical section that claims it, so a reader never sees it half written
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (trace_stamp_rate == 0)
+    {
+        trace_stamp_rate = task_msg_trace_stamp_rate();
+    }
+    struct task_msg_trace_record *record = &trace_buffer[trace_index++ & (TASK_MSG_TRACE_RECORDS - 1)];
+    record->stamp = task_msg_trace_stamp();
+    record->event = event;
+    record->msg_name = msg_name;
+    record->subscriber_id = subscriber_id;
+    record->in_flight = in_flight;
+    record->arg = arg;
+    rt_hw_interrupt_enable(level);
+}
+
+/**
+ * Copy the latest trace records, oldest first.
+ *
+ * @param records: output buffer
+ * @param count: output buffer length
+ * @return the number of copied records
+ */
+rt_uint32_t task_msg_trace_read(struct task_msg_trace_record *records, rt_uint32_t count)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    rt_uint32_t end = trace_index;
+    rt_hw_interrupt_enable(level);
+
+    rt_uint32_t total = end < TASK_MSG_TRACE_RECORDS ? end : TASK_MSG_TRACE_RECORDS;
+    if (count > total)
+        count = total;
+    for (rt_uint32_t i = 0; i < count; i++)
+    {
+        records[i] = trace_buffer[(end - count + i) & (TASK_MSG_TRACE_RECORDS - 1)];
+    }
+    return count;
+}
+
+/**
+ * Start or stop recording.
+ * @param enable: RT_TRUE:start, RT_FALSE:stop
+ */
+void task_msg_trace_enable(rt_bool_t enable)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    if (enable && !trace_enable)
+    {
+        trace_stamp_rate = task_msg_trace_stamp_rate();
+    }
+    trace_enable = enable;
+    rt_hw_interrupt_enable(level);
+}
+
+/**
+ * Drop all trace records.
+ */
+void task_msg_trace_clear(void)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    trace_index = 0;
+    trace_stamp_rate = 0;
+    rt_hw_interrupt_enable(level);
+}
+
+/**
+ * Print the trace records, oldest first, the recording is paused while dumping.
+ * @param raw: RT_TRUE:print hex records for tools/task_msg_trace_decode.py, RT_FALSE:print text
+ */
+void task_msg_trace_dump(rt_bool_t raw)
+{
+    struct task_msg_trace_record record;
+    rt_bool_t enable = trace_enable;
+    trace_enable = RT_FALSE;
+
+    rt_uint32_t end = trace_index;
+    rt_uint32_t total = end < TASK_MSG_TRACE_RECORDS ? end : TASK_MSG_TRACE_RECORDS;
+    if (raw)
+    {
+        rt_kprintf("TMT begin %d %d\n", total, trace_stamp_rate ? trace_stamp_rate : task_msg_trace_stamp_rate());
+    }
+    for (rt_uint32_t i = end - total; i != end; i++)
+    {
+        record = trace_buffer[i & (TASK_MSG_TRACE_RECORDS - 1)];
+        if (raw)
+        {
+            rt_kprintf("TMT %08x %02x %02x %04x %04x %04x\n", record.stamp, record.event, record.msg_name,
+                    (rt_uint16_t) record.subscriber_id, record.in_flight, record.arg);
+        }
+        else
+        {
+            rt_kprintf("%10u %-10s msg:%-3d sub:%-3d in_flight:%-5d arg:%d\n", record.stamp,
+                    record.event < TASK_MSG_TRACE_EVENT_COUNT ? trace_event_name[record.event] : "?",
+                    record.msg_name, record.subscriber_id, record.in_flight, record.arg);
+        }
+    }
+    if (raw)
+    {
+        rt_kprintf("TMT end\n");
+    }
+
+    trace_enable = enable;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+static int task_msg_trace(int argc, char **argv)
+{
+    if (argc > 1 && rt_strcmp(argv[1], "clear") == 0)
+        task_msg_trace_clear();
+    else if (argc > 1 && rt_strcmp(argv[1], "on") == 0)
+        task_msg_trace_enable(RT_TRUE);
+    else if (argc > 1 && rt_strcmp(argv[1], "off") == 0)
+        task_msg_trace_enable(RT_FALSE);
+    else
+        task_msg_trace_dump(argc > 1 && rt_strcmp(argv[1], "raw") == 0);
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(task_msg_trace, task msg bus flight recorder: task_msg_trace [raw|clear|on|off]);
+#endif
+
+#endif /* TASK_MSG_USING_TRACE */
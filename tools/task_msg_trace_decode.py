@@ -0,0 +1,81 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Copyright (c) 2006-2020, RT-Thread Development Team
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Decode the output of 'task_msg_trace raw' into a timeline.
+#
+# usage: python task_msg_trace_decode.py console.log [--names TASK_MSG_OS_REDAY,TASK_MSG_NET_REDAY,...]
+#
+
+import sys
+import argparse
+
+EVENTS = ['publish', 'dispatch', 'dispatched', 'cb_enter', 'cb_exit', 'wakeup', 'release', 'drop', 'timer', 'expire']
+
+
+def parse(lines):
+    records = []
+    tick_per_second = 1000
+    for line in lines:
+        fields = line.split()
+        if len(fields) < 2 or 'TMT' not in fields:
+            continue
+        fields = fields[fields.index('TMT') + 1:]
+        if fields[0] == 'begin':
+            records = []
+            tick_per_second = int(fields[2])
+        elif fields[0] == 'end':
+            break
+        elif len(fields) == 6:
+            stamp, event, msg_name, sub, in_flight, arg = [int(f, 16) for f in fields]
+            if sub >= 0x8000:
+                sub -= 0x10000
+            records.append((stamp, event, msg_name, sub, in_flight, arg))
+    return records, tick_per_second
+
+
+def render(records, tick_per_second, names):
+    if not records:
+        print('no trace records')
+        return
+
+    base = records[0][0]
+    dispatch_start = {}
+    for stamp, event, msg_name, sub, in_flight, arg in records:
+        name = names[msg_name] if msg_name < len(names) else 'msg%d' % msg_name
+        event_name = EVENTS[event] if event < len(EVENTS) else 'event%d' % event
+        delta = (stamp - base) & 0xFFFFFFFF
+        note = ''
+        if event == 1:
+            dispatch_start[msg_name] = stamp
+        elif event == 2 and msg_name in dispatch_start:
+            note = 'took %d, %d subscribers' % ((stamp - dispatch_start.pop(msg_name)) & 0xFFFFFFFF, arg)
+        elif event == 6:
+            note = 'refs left %d' % arg
+        elif event in (3, 4):
+            note = 'callback #%d' % arg
+        sub_text = '' if sub < 0 else 'sub %d' % sub
+        bar = '#' * min(in_flight, 40)
+        print('%10d %-10s %-24s %-7s %5d %-40s %s' % (delta, event_name, name, sub_text, in_flight, bar, note))
+
+    span = (records[-1][0] - base) & 0xFFFFFFFF
+    print('%d records, span %d stamps (%d stamps per second)' % (len(records), span, tick_per_second))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='decode task msg bus flight recorder dumps')
+    parser.add_argument('log', nargs='?', help='console log file, default stdin')
+    parser.add_argument('--names', default='', help='comma separated enum task_msg_name names')
+    args = parser.parse_args()
+
+    lines = open(args.log).readlines() if args.log else sys.stdin.readlines()
+    names = [n for n in args.names.split(',') if n]
+    records, tick_per_second = parse(lines)
+    render(records, tick_per_second, names)
+
+
+if __name__ == '__main__':
+    main()